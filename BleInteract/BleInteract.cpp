@@ -24,6 +24,22 @@
 #include <locale>
 #include <windows.storage.streams.h>
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
 
 using namespace winrt;
 using namespace winrt::Windows::Storage::Streams;
@@ -41,6 +57,26 @@ std::shared_ptr<BluetoothLEDevice> connectedDevice = nullptr;
 std::shared_ptr<GattCharacteristic> rxCharacteristic = nullptr;
 std::shared_ptr<GattCharacteristic> txCharacteristic = nullptr;
 
+// Guards the connection state below (device, characteristics, GATT session and event tokens)
+// Java threads, the writer thread and WinRT event threads read it while connect and teardown replace it
+std::mutex connectionMutex;
+
+// Functions to read a snapshot of the connection state, safe from any thread
+std::shared_ptr<BluetoothLEDevice> GetConnectedDevice() {
+    std::lock_guard<std::mutex> lock(connectionMutex);
+    return connectedDevice;
+}
+
+std::shared_ptr<GattCharacteristic> GetRxCharacteristic() {
+    std::lock_guard<std::mutex> lock(connectionMutex);
+    return rxCharacteristic;
+}
+
+std::shared_ptr<GattCharacteristic> GetTxCharacteristic() {
+    std::lock_guard<std::mutex> lock(connectionMutex);
+    return txCharacteristic;
+}
+
 // Global variables to store UART UUIDs
 std::optional<winrt::guid> uartServiceGuid = std::nullopt;
 std::optional<winrt::guid> rxUuid = std::nullopt;
@@ -49,6 +85,206 @@ std::optional<winrt::guid> txUuid = std::nullopt;
 // Global variable to store the global reference to the Java object
 jobject globalObj = nullptr;
 
+// Event handlers that may reach Java, cleanup closes them and waits for running ones before deleting globalObj
+// Revoking a WinRT event does not wait for a handler that is already running
+std::atomic<int> activeHandlers{ 0 };
+std::atomic<bool> handlersOpen{ false };
+thread_local int handlerDepth = 0; // Handlers running on this thread, cleanup called from inside one cannot wait for it
+
+// RAII guard entered first by every event handler, false once cleanup closed the handlers
+struct HandlerGuard {
+    bool entered;
+
+    HandlerGuard() {
+        activeHandlers++;
+        handlerDepth++;
+        entered = handlersOpen.load();
+    }
+
+    ~HandlerGuard() {
+        handlerDepth--;
+        activeHandlers--;
+    }
+
+    explicit operator bool() const {
+        return entered;
+    }
+};
+
+// GATT session of the connected device, used to follow the negotiated MTU (guarded by connectionMutex)
+std::shared_ptr<GattSession> gattSession = nullptr;
+
+// Event registrations, revoked on teardown so no callback fires after cleanup (guarded by connectionMutex)
+winrt::event_token valueChangedToken{};
+winrt::event_token connectionStatusChangedToken{};
+winrt::event_token maxPduSizeChangedToken{};
+
+// Steps that teardown could not finish cleanly, returned as a bit mask (must match BluetoothBLE.TEARDOWN_*)
+enum TeardownFlag : int {
+    TEARDOWN_CLEAN = 0,
+    TEARDOWN_WRITER = 1,      // Writer thread was stuck in a write and has been detached
+    TEARDOWN_UNSUBSCRIBE = 2, // Notifications could not be disabled on the device
+    TEARDOWN_HANDLERS = 4,    // An event handler could not be revoked
+    TEARDOWN_CLOSE = 8        // Device or GATT session did not close in time
+};
+
+// Default deadline for each teardown step
+constexpr auto DEFAULT_TEARDOWN_TIMEOUT = std::chrono::milliseconds(500);
+
+// Outbound priority lanes, a lower value is sent first (must match BluetoothBLE.PRIORITY_*)
+enum OutboundPriority : int {
+    PRIORITY_CONTROL = 0,
+    PRIORITY_INTERACTIVE = 1,
+    PRIORITY_BULK = 2,
+    PRIORITY_COUNT = 3
+};
+
+// Metric counters exposed to Java through getMetrics (must match BluetoothBLE.METRIC_*)
+enum MetricIndex : int {
+    METRIC_SENT_CONTROL = 0,
+    METRIC_SENT_INTERACTIVE,
+    METRIC_SENT_BULK,
+    METRIC_DROPPED_CONTROL,
+    METRIC_DROPPED_INTERACTIVE,
+    METRIC_DROPPED_BULK,
+    METRIC_FRAGMENTS_WRITTEN,
+    METRIC_WRITE_FAILURES,
+    METRIC_FRAGMENT_SIZE,
+    METRIC_UNCLEAN_TEARDOWNS,
+    METRIC_BYTES_WRITTEN,
+    METRIC_WRITE_WINDOW,
+    METRIC_COALESCE_BYTES,
+    METRIC_WRITE_MODE,
+    METRIC_ROUND_TRIP_MICROS,
+    METRIC_THROUGHPUT,
+    METRIC_CHANNEL_FRAMES_SENT,
+    METRIC_CHANNEL_FRAMES_FAILED,
+    METRIC_CHANNEL_FRAMES_RECEIVED,
+    METRIC_CHANNEL_REJECTED,
+    METRIC_NOTIFICATION_BATCHES,
+    METRIC_NOTIFICATIONS_BATCHED,
+    METRIC_NOTIFICATIONS_DROPPED,
+    METRIC_COLD_START_MICROS,
+    METRIC_FIRST_SCAN_MICROS,
+    METRIC_UNLOAD_THREADS_LEFT,
+    METRIC_COUNT
+};
+
+std::atomic<int64_t> metrics[METRIC_COUNT] = {};
+
+// Threads started by the library that may still run its code, JNI_OnUnload waits a bounded time for them
+// Counted before the thread is created, so an unload never misses a thread that has not started yet
+std::atomic<int> libraryThreads{ 0 };
+
+// Ends the count of a library thread once it is done with everything but releasing its module reference
+struct LibraryThreadExit {
+    ~LibraryThreadExit() {
+        libraryThreads--;
+    }
+};
+
+// Function to start a thread that runs library code, every thread holds a reference on this module
+// A thread left behind at unload keeps the code mapped and drops the reference in FreeLibraryAndExitThread,
+// so the module is only unmapped once the last of them is gone. The body is moved out of the std::thread
+// state before running, FreeLibraryAndExitThread skips its destructor and would otherwise keep the captures.
+template <typename Function>
+std::thread StartLibraryThread(Function&& body) {
+    HMODULE module = nullptr;
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(&libraryThreads), &module)) {
+        module = nullptr; // Without a reference the thread returns normally, JNI_OnUnload still waits for it
+    }
+
+    libraryThreads++;
+    return std::thread([body = std::forward<Function>(body), module]() mutable {
+        {
+            LibraryThreadExit threadExit;
+            auto run = std::move(body);
+            run();
+        }
+
+        if (module) {
+            FreeLibraryAndExitThread(module, 0);
+        }
+    });
+}
+
+// Struct to hold a message waiting in one of the outbound lanes
+struct OutboundMessage {
+    uint64_t id;
+    std::vector<uint8_t> data;
+    size_t offset = 0; // Bytes already written
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    std::function<void(bool)> onComplete;
+    bool windowed = false; // Fragments are written without response, only the last one is acknowledged
+    uint64_t traceId = 0;  // Set when the message is sampled for tracing
+    int64_t enqueuedAt = 0;
+    bool interruptible = false; // Self-delimiting on the wire, so higher lanes may write between its fragments
+};
+
+// Outbound queue state, everything is guarded by outboundMutex
+std::mutex outboundMutex;
+std::condition_variable outboundCondition;
+std::deque<OutboundMessage> outboundQueues[PRIORITY_COUNT];
+std::thread outboundWriter;
+std::future<void> outboundWriterExited;
+bool outboundRunning = false;
+uint64_t outboundGeneration = 0; // A writer that was left behind by teardown exits once this changes
+uint64_t nextOutboundId = 1;
+
+// Completions of messages that already left the queue (coalesced or handed to the stack), keyed by completion id
+// Whoever takes one out runs it, so StopOutboundWriter can fail them while a stuck writer still holds the write
+std::unordered_map<uint64_t, std::function<void(bool)>> detachedCompletions;
+uint64_t nextCompletionId = 1;
+
+// Payload bytes per write, ATT_MTU minus the 3 byte ATT header (23 byte default MTU)
+std::atomic<uint32_t> fragmentSize{ 20 };
+
+// Number of writes without response that may be in flight, and if the RX characteristic allows them
+constexpr uint32_t DEFAULT_WRITE_WINDOW = 4;
+std::atomic<uint32_t> writeWindow{ DEFAULT_WRITE_WINDOW };
+std::atomic<bool> rxWithoutResponse{ false };
+
+// Writer settings adjusted by the tuner
+std::atomic<uint32_t> coalesceBytes{ 0 };      // Small messages are merged into writes up to this size, 0 = one message per write
+std::atomic<bool> unacknowledgedMode{ false }; // Interactive and bulk lanes are written without response
+// A write without response succeeds once the stack queued it, packets lost over the air are never reported
+
+// Limits for the throughput tuner, set through configureTuner
+struct TunerConfig {
+    bool enabled = false;
+    uint32_t minWindow = 1;
+    uint32_t maxWindow = 16;
+    uint32_t maxCoalesce = 0;
+    bool allowWithoutResponse = false;
+};
+
+// Measurements of the current tuning period
+struct TunerState {
+    std::chrono::steady_clock::time_point periodStart{};
+    int64_t bytesAtStart = 0;
+    int64_t failuresAtStart = 0;
+    double lastThroughput = 0;
+    int64_t baseRoundTrip = 0;
+    int cleanPeriods = 0;
+};
+
+std::mutex tunerMutex;
+TunerConfig tunerConfig;
+TunerState tunerState;
+
+// Length of a tuning period, long enough to average out connection interval jitter
+constexpr auto TUNER_PERIOD = std::chrono::milliseconds(500);
+
+// Moving average of a single fragment write, used to decide if a deadline can still be met
+std::atomic<int64_t> fragmentWriteMicros{ 0 };
+
+// Function to add a completed write to the moving average, only called by the writer thread
+void RecordWriteLatency(int64_t elapsedMicros) {
+    int64_t average = fragmentWriteMicros.load();
+    fragmentWriteMicros.store(average == 0 ? elapsedMicros : (average * 7 + elapsedMicros) / 8);
+    metrics[METRIC_ROUND_TRIP_MICROS].store(fragmentWriteMicros.load());
+}
+
 // Struct to hold device information
 struct DeviceInfo {
     std::wstring name;
@@ -84,6 +320,20 @@ std::vector<uint8_t> WStringToUTF8Bytes(const std::wstring& wstr) {
     return std::vector<uint8_t>(utf8Str.begin(), utf8Str.end());
 }
 
+// Function to copy a Java string as UTF-8 bytes
+std::vector<uint8_t> JStringToUTF8Bytes(JNIEnv* env, jstring str) {
+    if (str == nullptr) {
+        return {};
+    }
+
+    // GetStringUTFRegion also writes a terminating zero on most JVMs
+    jsize utfLength = env->GetStringUTFLength(str);
+    std::vector<uint8_t> bytes(utfLength + 1);
+    env->GetStringUTFRegion(str, 0, env->GetStringLength(str), reinterpret_cast<char*>(bytes.data()));
+    bytes.resize(utfLength);
+    return bytes;
+}
+
 void init() {
     std::locale::global(std::locale(""));
 
@@ -96,6 +346,7 @@ void saveGlobalReference(JNIEnv* env, jobject javaObject) {
     if (globalObj == nullptr) {  // Only save if it's not already saved
         globalObj = env->NewGlobalRef(javaObject);
     }
+    handlersOpen.store(true);
 }
 
 // Function to get the saved global reference
@@ -103,180 +354,1858 @@ jobject getGlobalReference() {
     return globalObj;  // Return the saved global reference
 }
 
-// Function to clean up the global reference
-void cleanup(JNIEnv* env) {
-    if (env == nullptr) {
-        return; // Fail-safe: No valid environment
+// Struct to hold one traced stage, stored as a Chrome trace complete event
+struct TraceEvent {
+    const char* name; // Always a string literal
+    uint64_t traceId;
+    int64_t start;    // Microseconds on the steady clock
+    int64_t duration;
+};
+
+// Events kept per thread, older events are overwritten
+constexpr size_t TRACE_BUFFER_SIZE = 4096;
+
+// Per thread ring buffer, only the owning thread writes and head publishes its events
+// A dump racing a wrapping writer may read a torn event, which is acceptable for diagnostics
+struct TraceBuffer {
+    DWORD threadId = 0;
+    std::atomic<uint64_t> head{ 0 };
+    std::atomic<uint64_t> start{ 0 }; // First event that was not cleared yet
+    std::atomic<bool> retired{ false }; // Owning thread exited, the buffer is kept until dumped or reused
+    TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+// Most buffers kept at once, retired ones are reused before a new one is allocated
+constexpr size_t MAX_TRACE_BUFFERS = 64;
+
+// Tracing state, the registry lock is only taken once per thread and by dumps
+std::atomic<bool> tracingEnabled{ false };
+std::atomic<uint32_t> traceSampleEvery{ 1 };
+std::atomic<uint64_t> traceCounter{ 0 };
+std::mutex traceRegistryMutex;
+std::vector<std::shared_ptr<TraceBuffer>> traceBuffers;
+
+// Bumped whenever a buffer may have become free, a thread that was refused one retries after it changed
+std::atomic<uint64_t> traceBufferReleases{ 0 };
+
+// Per thread handle, retires the buffer when the thread exits
+struct TraceBufferHandle {
+    std::shared_ptr<TraceBuffer> buffer;
+    bool unavailable = false;  // Every buffer was owned by a live thread at the last attempt
+    uint64_t releasesSeen = 0; // traceBufferReleases at the last attempt
+
+    ~TraceBufferHandle() {
+        if (buffer) {
+            buffer->retired.store(true);
+            traceBufferReleases++;
+        }
     }
+};
 
-    // Stop notification
-    if (txCharacteristic)
-    {
-        try {
-            auto status = txCharacteristic->WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::None
-            ).get();
+thread_local TraceBufferHandle threadTraceBuffer;
 
-            if (status == GattCommunicationStatus::Success) {
-                std::cout << "Notifications stopped successfully." << std::endl;
-            }
-            else {
-                std::cerr << "Failed to stop notifications." << std::endl;
-            }
+// Function to hand the calling thread a buffer, reusing retired ones first (dumped ones before undumped ones)
+std::shared_ptr<TraceBuffer> AcquireTraceBuffer() {
+    std::lock_guard<std::mutex> lock(traceRegistryMutex);
 
-            txCharacteristic.reset();
+    std::shared_ptr<TraceBuffer> reuse;
+    for (const auto& buffer : traceBuffers) {
+        if (!buffer->retired.load()) {
+            continue;
         }
-        catch (const winrt::hresult_error& ex) {
-            std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+        if (buffer->start.load() == buffer->head.load()) {
+            reuse = buffer;
+            break;
         }
-        catch (const std::exception& ex) {
-            std::cerr << "Standard Exception: " << ex.what() << std::endl;
+        if (!reuse) {
+            reuse = buffer;
         }
-        catch (...) {
-            std::cerr << "Unknown exception occurred while stopping notifications." << std::endl;
+    }
+
+    // Below the cap a fresh buffer keeps the undumped events of exited threads
+    if (!reuse || (reuse->start.load() != reuse->head.load() && traceBuffers.size() < MAX_TRACE_BUFFERS)) {
+        if (traceBuffers.size() >= MAX_TRACE_BUFFERS) {
+            return nullptr;
         }
+
+        traceBuffers.push_back(std::make_shared<TraceBuffer>());
+        reuse = traceBuffers.back();
     }
 
-    // Stop receiving
-    if (rxCharacteristic)
-    {
-        try {
-            rxCharacteristic.reset();
+    // Dumps hold the registry lock, so nothing reads the buffer while it is reset
+    reuse->threadId = GetCurrentThreadId();
+    reuse->head.store(0);
+    reuse->start.store(0);
+    reuse->retired.store(false);
+    return reuse;
+}
+
+// Function to read the monotonic trace clock in microseconds
+int64_t TraceNow() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Function to decide if a new message is traced, returns its trace id or 0
+uint64_t TraceSample() {
+    if (!tracingEnabled.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+
+    uint64_t count = traceCounter.fetch_add(1, std::memory_order_relaxed) + 1;
+    return count % traceSampleEvery.load(std::memory_order_relaxed) == 0 ? count : 0;
+}
+
+// Function to record a stage of a traced message in the buffer of the calling thread
+void TraceSpan(const char* name, uint64_t traceId, int64_t start, int64_t end) {
+    if (traceId == 0) {
+        return;
+    }
+
+    if (!threadTraceBuffer.buffer) {
+        uint64_t releases = traceBufferReleases.load(std::memory_order_relaxed);
+        if (threadTraceBuffer.unavailable && threadTraceBuffer.releasesSeen == releases) {
+            return; // Nothing was released since the last refusal
         }
-        catch (const winrt::hresult_error& ex) {
-            std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+
+        threadTraceBuffer.releasesSeen = releases;
+        threadTraceBuffer.buffer = AcquireTraceBuffer();
+        threadTraceBuffer.unavailable = !threadTraceBuffer.buffer;
+        if (!threadTraceBuffer.buffer) {
+            return;
         }
-        catch (const std::exception& ex) {
-            std::cerr << "Standard Exception: " << ex.what() << std::endl;
+    }
+
+    TraceBuffer& buffer = *threadTraceBuffer.buffer;
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % TRACE_BUFFER_SIZE] = { name, traceId, start, end - start };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+// Records the lifetime of a scope as one stage
+struct TraceScope {
+    const char* name;
+    uint64_t traceId;
+    int64_t start;
+
+    TraceScope(const char* name, uint64_t traceId) : name(name), traceId(traceId), start(traceId ? TraceNow() : 0) {}
+    ~TraceScope() {
+        if (traceId) {
+            TraceSpan(name, traceId, start, TraceNow());
         }
-        catch (...) {
-            std::cerr << "Unknown exception occurred while stopping write operation." << std::endl;
+    }
+};
+
+// Function to export all recorded stages as Chrome / Perfetto trace JSON, optionally clearing them
+std::string DumpTrace(bool clear) {
+    std::ostringstream json;
+    json << "{\"traceEvents\":[";
+
+    bool first = true;
+    std::lock_guard<std::mutex> lock(traceRegistryMutex);
+
+    for (const auto& buffer : traceBuffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = (std::max)(buffer->start.load(), head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0);
+
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent& event = buffer->events[i % TRACE_BUFFER_SIZE];
+
+            json << (first ? "" : ",")
+                << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+                << ",\"args\":{\"trace\":" << event.traceId << "}}";
+            first = false;
+        }
+
+        if (clear) {
+            buffer->start.store(head);
         }
     }
-    
-    // Stop connection 
-    if (connectedDevice) {
-        connectedDevice->Close();
-        connectedDevice.reset();
-        connectedDevice = nullptr;
+
+    // Buffers of exited threads are released once their events were exported
+    if (clear) {
+        auto released = std::remove_if(traceBuffers.begin(), traceBuffers.end(), [](const auto& buffer) {
+            return buffer->retired.load() && buffer->start.load() == buffer->head.load();
+        });
+        if (released != traceBuffers.end()) {
+            traceBuffers.erase(released, traceBuffers.end());
+            traceBufferReleases++;
+        }
     }
 
-    uartServiceGuid.reset();
-    rxUuid.reset();
-    txUuid.reset();
-   
-    if (globalObj != nullptr) {
-        env->DeleteGlobalRef(globalObj);  // Delete the global reference when done
-        globalObj = nullptr;  // Set to nullptr to avoid dangling reference
+    json << "],\"displayTimeUnit\":\"ms\"}";
+    return json.str();
+}
+
+// Java callbacks resolved once in JNI_OnLoad, GetCallback falls back to a lookup for anything missing
+struct CallbackEntry {
+    const char* name;
+    const char* signature;
+    jmethodID id;
+};
+
+// Native runtime created once in JNI_OnLoad, it owns everything calls used to set up lazily
+struct NativeRuntime {
+    JavaVM* jvm = nullptr;
+    CO_MTA_USAGE_COOKIE mtaCookie = nullptr; // Keeps the multi threaded apartment alive for every thread of the process
+    int64_t loadedAt = 0;                    // TraceNow() at JNI_OnLoad
+
+    // JNI caches, written in JNI_OnLoad and read only afterwards
+    jclass bleClass = nullptr;
+    jclass deviceClass = nullptr;
+    jmethodID deviceConstructor = nullptr;
+    jclass arrayListClass = nullptr;
+    jmethodID arrayListConstructor = nullptr;
+    jmethodID arrayListAdd = nullptr;
+    CallbackEntry callbacks[8] = {
+        { "onDeviceConnected", "(Ljava/lang/String;)V", nullptr },
+        { "onDeviceDisconnected", "(Ljava/lang/String;)V", nullptr },
+        { "onDeviceNotificationReceived", "(Ljava/lang/String;)V", nullptr },
+        { "onChannelData", "(I[B)V", nullptr },
+        { "onSensorBatch", "(I[FII)V", nullptr },
+        { "onSensorBatchRaw", "(I[SII)V", nullptr },
+        { "onTransferProgress", "(JJ)V", nullptr },
+        { "onNotificationBatch", "(Ljava/nio/ByteBuffer;I)V", nullptr }
+    };
+
+    // Completed by the warm-up thread, true once the Bluetooth stack answered
+    std::promise<bool> readyPromise;
+    std::shared_future<bool> ready;
+    std::atomic<bool> scanned{ false };
+
+    // Set by JNI_OnUnload, threads left behind by an earlier unload keep the module loaded for a later JNI_OnLoad
+    std::atomic<bool> unloading{ false };
+};
+
+NativeRuntime runtime;
+
+// Function to get the method id of a Java callback, exceptions of a missing method are cleared
+jmethodID GetCallback(JNIEnv* env, jobject javaObject, const char* name, const char* signature) {
+    for (const auto& entry : runtime.callbacks) {
+        if (entry.id != nullptr && std::strcmp(entry.name, name) == 0 && std::strcmp(entry.signature, signature) == 0) {
+            return entry.id;
+        }
+    }
+
+    jclass javaClass = env->GetObjectClass(javaObject);
+    jmethodID methodId = env->GetMethodID(javaClass, name, signature);
+    env->DeleteLocalRef(javaClass);
+    if (!methodId) {
+        env->ExceptionClear();
     }
+    return methodId;
 }
 
-// Calling java method from the class
-void CallJavaMethod(JNIEnv* env, jobject javaObject, const char* methodName, const char* methodSig, const char* message) {
+// Function to record the time from loading the library to the first scan
+void RecordFirstScan() {
+    if (runtime.loadedAt != 0 && !runtime.scanned.exchange(true)) {
+        metrics[METRIC_FIRST_SCAN_MICROS].store(TraceNow() - runtime.loadedAt);
+    }
+}
+
+// Function to park a completion outside the queue, outboundMutex must be held; returns 0 for an empty one
+uint64_t DetachCompletionLocked(std::function<void(bool)>&& onComplete) {
+    if (!onComplete) {
+        return 0;
+    }
+
+    uint64_t completionId = nextCompletionId++;
+    detachedCompletions.emplace(completionId, std::move(onComplete));
+    return completionId;
+}
+
+// Function to take a parked completion back, empty when StopOutboundWriter already failed it
+std::function<void(bool)> TakeCompletion(uint64_t completionId) {
+    if (completionId == 0) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(outboundMutex);
+    auto found = detachedCompletions.find(completionId);
+    if (found == detachedCompletions.end()) {
+        return {};
+    }
+
+    auto onComplete = std::move(found->second);
+    detachedCompletions.erase(found);
+    return onComplete;
+}
+
+// Write without response that was handed to the stack but not completed yet
+struct InFlightWrite {
+    uint64_t messageId; // 0 once the message completed without waiting for this write
+    int lane;
+    uint32_t messages; // Messages completed by this write, more than one when coalesced
+    winrt::Windows::Foundation::IAsyncOperation<GattCommunicationStatus> operation;
+    uint64_t completionId; // Only set when the write finishes its message(s)
+    std::chrono::steady_clock::time_point started;
+};
+
+// Function to write a single fragment to the RX characteristic
+bool WriteFragment(const std::shared_ptr<GattCharacteristic>& characteristic, const std::vector<uint8_t>& fragment) {
+    if (!characteristic) {
+        return false;
+    }
+
     try {
-        if (env == nullptr) {
-            std::cout << "env is null" << std::endl;
-            return;
+        DataWriter writer;
+        writer.WriteBytes(fragment);
+
+        auto status = characteristic->WriteValueAsync(writer.DetachBuffer(), GattWriteOption::WriteWithResponse).get();
+        return status == GattCommunicationStatus::Success;
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception while writing fragment: " << winrt::to_string(e.message()) << std::endl;
+        return false;
+    }
+}
+
+// Function to start a write without response, the result is collected later by DrainInFlightWrites
+bool StartUnacknowledgedWrite(const std::shared_ptr<GattCharacteristic>& characteristic, const std::vector<uint8_t>& fragment, uint64_t messageId, int lane, uint32_t messages, uint64_t completionId, std::deque<InFlightWrite>& inFlight) {
+    if (!characteristic) {
+        return false;
+    }
+
+    try {
+        DataWriter writer;
+        writer.WriteBytes(fragment);
+
+        auto operation = characteristic->WriteValueAsync(writer.DetachBuffer(), GattWriteOption::WriteWithoutResponse);
+        inFlight.push_back({ messageId, lane, messages, operation, completionId, std::chrono::steady_clock::now() });
+        return true;
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception while writing fragment: " << winrt::to_string(e.message()) << std::endl;
+        return false;
+    }
+}
+
+// Function to wait for in-flight writes until at most `keep` remain, failed messages are remembered
+void DrainInFlightWrites(std::deque<InFlightWrite>& inFlight, size_t keep, std::unordered_set<uint64_t>& failed) {
+    while (inFlight.size() > keep) {
+        InFlightWrite write = std::move(inFlight.front());
+        inFlight.pop_front();
+
+        // Only a write still pending when waited for completes now, an earlier completion time is unknown
+        bool pending = false;
+        bool written = false;
+        try {
+            pending = write.operation.Status() == winrt::Windows::Foundation::AsyncStatus::Started;
+            written = write.operation.get() == GattCommunicationStatus::Success;
+        }
+        catch (const winrt::hresult_error& e) {
+            std::cerr << "Exception while writing fragment: " << winrt::to_string(e.message()) << std::endl;
         }
 
-        if (javaObject == nullptr) {
-            std::cout << "javaObject is null" << std::endl;
-            return;
+        // Completion latency of writes without response, it grows when the stack queues them
+        if (written && pending) {
+            RecordWriteLatency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - write.started).count());
         }
 
+        if (!written) {
+            metrics[METRIC_WRITE_FAILURES]++;
+            if (write.messageId != 0) {
+                failed.insert(write.messageId);
+            }
+        }
 
-        jclass javaClass = env->GetObjectClass(javaObject);
-        if (!javaClass) {
-            std::cout << "Failed to find Java class." << std::endl;
-            return;
+        // Last write of a message, earlier fragments of it were drained before
+        if (write.completionId != 0) {
+            bool success = failed.erase(write.messageId) == 0;
+            auto onComplete = TakeCompletion(write.completionId);
+            if (onComplete) {
+                if (success) {
+                    metrics[METRIC_SENT_CONTROL + write.lane] += write.messages;
+                }
+                onComplete(success);
+            }
         }
+    }
+}
 
-        jmethodID methodId = env->GetMethodID(javaClass, methodName, methodSig);
-        if (!methodId) {
-            std::cout << "Failed to find Java method: " << methodName << std::endl;
-            env->DeleteLocalRef(javaClass);  // Release the local reference
-            return;
+// Function to detach in-flight writes from a message that completed without them, so their failures are not kept
+void ForgetInFlightMessage(std::deque<InFlightWrite>& inFlight, uint64_t messageId) {
+    for (auto& write : inFlight) {
+        if (write.messageId == messageId) {
+            write.messageId = 0;
         }
+    }
+}
 
-        // Convert the message to a Java string
-        jstring javaMessage = env->NewStringUTF(message);
-        if (!javaMessage) {
-            std::cout << "Failed to create Java string from message." << std::endl;
-            env->DeleteLocalRef(javaClass);  // Release the local reference
-            return;
+// Function to fail in-flight writes without waiting for them, used when the writer exits
+void AbandonInFlightWrites(std::deque<InFlightWrite>& inFlight) {
+    for (auto& write : inFlight) {
+        auto onComplete = TakeCompletion(write.completionId);
+        if (onComplete) {
+            onComplete(false);
         }
+    }
+    inFlight.clear();
+}
 
-        // Call the Java method
-        env->CallVoidMethod(javaObject, methodId, javaMessage);
+// Check if a message that has not started yet can still be written before its deadline
+bool CanMeetDeadline(const OutboundMessage& message, std::chrono::steady_clock::time_point now) {
+    if (!message.deadline) {
+        return true;
+    }
 
-        // Delete local references
-        env->DeleteLocalRef(javaMessage);
-        env->DeleteLocalRef(javaClass);  // Don't forget to delete the class reference
+    uint32_t size = fragmentSize.load();
+    int64_t fragments = (int64_t)((message.data.size() + size - 1) / size);
+    auto estimate = std::chrono::microseconds(fragments * fragmentWriteMicros.load());
+
+    return now + estimate <= *message.deadline;
+}
+
+// Function to publish the writer settings chosen by the tuner
+void PublishWriterSettings() {
+    metrics[METRIC_WRITE_WINDOW].store(writeWindow.load());
+    metrics[METRIC_COALESCE_BYTES].store(coalesceBytes.load());
+    metrics[METRIC_WRITE_MODE].store(unacknowledgedMode.load() ? 1 : 0);
+}
+
+// Function to reset the writer settings and tuner measurements, e.g. for a new connection
+void ResetWriterTuning() {
+    std::lock_guard<std::mutex> lock(tunerMutex);
+
+    tunerState = TunerState{};
+    writeWindow.store(tunerConfig.enabled ? tunerConfig.minWindow : DEFAULT_WRITE_WINDOW);
+    coalesceBytes.store(0);
+    unacknowledgedMode.store(false);
+    fragmentWriteMicros.store(0);
+
+    PublishWriterSettings();
+}
+
+// Function to adapt window depth, coalescing and write mode once per tuning period, called by the writer thread
+void TuneWriter(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(tunerMutex);
+    if (!tunerConfig.enabled) {
+        return;
     }
-    catch (const std::exception& e) {
-        std::cerr << "Exception in CallJavaMethod: " << e.what() << std::endl;
+
+    TunerState& state = tunerState;
+    int64_t bytesWritten = metrics[METRIC_BYTES_WRITTEN].load();
+    int64_t writeFailures = metrics[METRIC_WRITE_FAILURES].load();
+
+    if (state.periodStart == std::chrono::steady_clock::time_point{}) {
+        state.periodStart = now;
+        state.bytesAtStart = bytesWritten;
+        state.failuresAtStart = writeFailures;
+        return;
+    }
+
+    auto elapsed = now - state.periodStart;
+    if (elapsed < TUNER_PERIOD) {
+        return;
+    }
+
+    int64_t bytes = bytesWritten - state.bytesAtStart;
+    int64_t failures = writeFailures - state.failuresAtStart;
+    double throughput = bytes / std::chrono::duration<double>(elapsed).count();
+
+    // Lowest round trip seen so far, growth above it means writes are queueing in the stack
+    int64_t roundTrip = fragmentWriteMicros.load();
+    if (roundTrip > 0 && (state.baseRoundTrip == 0 || roundTrip < state.baseRoundTrip)) {
+        state.baseRoundTrip = roundTrip;
+    }
+
+    uint32_t window = writeWindow.load();
+    uint32_t coalesce = coalesceBytes.load();
+    uint32_t coalesceLimit = (std::min)(tunerConfig.maxCoalesce, fragmentSize.load());
+
+    if (failures > 0) {
+        // Back off hard on errors, writes without response are the first suspect
+        // Only stack-level failures show up here, without response a packet lost over the air still counts as written
+        window = window / 2;
+        coalesce = coalesce / 2;
+        if (unacknowledgedMode.exchange(false)) {
+            state.baseRoundTrip = 0; // Round trips of the two write modes are not comparable
+        }
+        state.cleanPeriods = 0;
+    }
+    else if (bytes > 0) {
+        state.cleanPeriods++;
+
+        bool queueing = state.baseRoundTrip > 0 && roundTrip > state.baseRoundTrip * 2;
+        if (queueing || throughput < state.lastThroughput * 0.9) {
+            // A deeper window only adds latency once the link is saturated
+            window = window - 1;
+        }
+        else {
+            window = window + 1;
+            coalesce = coalesce == 0 ? 32 : coalesce * 2;
+        }
+
+        if (tunerConfig.allowWithoutResponse && rxWithoutResponse.load() && state.cleanPeriods >= 4 && !unacknowledgedMode.exchange(true)) {
+            state.baseRoundTrip = 0;
+        }
+
+        state.lastThroughput = throughput;
     }
+
+    writeWindow.store((std::clamp)(window, tunerConfig.minWindow, tunerConfig.maxWindow));
+    coalesceBytes.store((std::min)(coalesce, coalesceLimit));
+
+    state.periodStart = now;
+    state.bytesAtStart = bytesWritten;
+    state.failuresAtStart = writeFailures;
+
+    metrics[METRIC_THROUGHPUT].store((int64_t)throughput);
+    PublishWriterSettings();
 }
 
-// Function to handle connection status change
-void OnConnectionStatusChanged(JNIEnv* env, jobject javaObject, BluetoothLEDevice const& sender, winrt::Windows::Foundation::IInspectable const& args) {
-    try {
-        // Get connection status of the device
-        auto status = sender.ConnectionStatus();
+// Writer thread, always sends the next fragment of the highest priority lane
+void OutboundWriterLoop(uint64_t generation, std::promise<void> exited) {
+    // Writes block on WinRT operations, so the writer lives in the multi threaded apartment
+    init_apartment();
+
+    // Writes without response still waiting for completion, and the messages they failed
+    std::deque<InFlightWrite> inFlight;
+    std::unordered_set<uint64_t> failed;
+
+    std::unique_lock<std::mutex> lock(outboundMutex);
+
+    while (true) {
+        outboundCondition.wait(lock, [generation] {
+            if (!outboundRunning || outboundGeneration != generation) {
+                return true;
+            }
+            for (const auto& queue : outboundQueues) {
+                if (!queue.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        });
+
+        if (!outboundRunning || outboundGeneration != generation) {
+            break;
+        }
+
+        // A started message that is not self-delimiting keeps the link until its last fragment,
+        // the board cannot separate bytes of two messages interleaved on the unframed UART stream
+        int lane = -1;
+        for (int i = 0; i < PRIORITY_COUNT; i++) {
+            if (!outboundQueues[i].empty() && outboundQueues[i].front().offset > 0 && !outboundQueues[i].front().interruptible) {
+                lane = i;
+                break;
+            }
+        }
+
+        // Otherwise pick the highest priority lane with pending data
+        if (lane < 0) {
+            lane = 0;
+            while (outboundQueues[lane].empty()) {
+                lane++;
+            }
+        }
+
+        auto& queue = outboundQueues[lane];
+        OutboundMessage& message = queue.front();
+        auto now = std::chrono::steady_clock::now();
+
+        // Drop messages that can no longer be sent in time, a started message is always finished
+        bool expired = message.offset == 0 && !CanMeetDeadline(message, now);
+
+        // Stop a windowed message as soon as one of its earlier fragments failed
+        bool windowFailed = message.windowed && failed.erase(message.id) > 0;
+
+        if (expired || windowFailed) {
+            ForgetInFlightMessage(inFlight, message.id);
+            auto onComplete = std::move(message.onComplete);
+            queue.pop_front();
+            if (expired) {
+                metrics[METRIC_DROPPED_CONTROL + lane]++;
+            }
+
+            lock.unlock();
+            if (onComplete) {
+                onComplete(false);
+            }
+            lock.lock();
+            continue;
+        }
+
+        auto characteristic = GetRxCharacteristic();
+
+        // Control messages are always acknowledged, other lanes follow the write mode picked by the tuner
+        bool acknowledged = lane == PRIORITY_CONTROL || !unacknowledgedMode.load() || !rxWithoutResponse.load();
+
+        // Time spent waiting in the lane, recorded when the first fragment is picked
+        uint64_t traceId = message.traceId;
+        if (traceId && message.offset == 0) {
+            TraceSpan("queue.wait", traceId, message.enqueuedAt, TraceNow());
+        }
+
+        std::vector<uint8_t> fragment;
+        uint64_t completionId = 0; // Completes the message(s) once this write finishes, parked so teardown can fail it
+        uint64_t id = message.id;
+        uint32_t messages = 1;
+        size_t length = 0;
+        bool coalesced = false;
+        bool unacknowledged = false;
+
+        // Coalesce small whole messages of the same lane into a single write
+        uint32_t coalesce = (std::min)(coalesceBytes.load(), fragmentSize.load());
+        if (coalesce > 0 && message.offset == 0 && !message.windowed && message.data.size() < coalesce && queue.size() > 1) {
+            std::vector<std::function<void(bool)>> completions;
+            messages = 0;
+
+            while (!queue.empty()) {
+                OutboundMessage& next = queue.front();
+                if (next.offset != 0 || next.windowed || fragment.size() + next.data.size() > coalesce || !CanMeetDeadline(next, now)) {
+                    break;
+                }
+
+                fragment.insert(fragment.end(), next.data.begin(), next.data.end());
+                if (next.onComplete) {
+                    completions.push_back(std::move(next.onComplete));
+                }
+                messages++;
+                queue.pop_front();
+            }
+
+            completionId = DetachCompletionLocked([completions = std::move(completions)](bool success) {
+                for (const auto& onComplete : completions) {
+                    onComplete(success);
+                }
+            });
+            coalesced = true;
+            unacknowledged = !acknowledged;
+        }
+        else {
+            // Copy the next fragment so the lock is not held while writing
+            length = (std::min)((size_t)fragmentSize.load(), message.data.size() - message.offset);
+            fragment.assign(message.data.begin() + message.offset, message.data.begin() + message.offset + length);
+
+            // Windowed messages only wait for a response on their last fragment, which acts as checkpoint
+            bool last = message.offset + length >= message.data.size();
+            unacknowledged = message.windowed ? !last && rxWithoutResponse.load() : !acknowledged;
+
+            // The last write without response completes the message when it is drained
+            if (unacknowledged && last) {
+                completionId = DetachCompletionLocked(std::move(message.onComplete));
+            }
+        }
+
+        lock.unlock();
+
+        bool written = false;
+        bool handedOff = false;
+        if (unacknowledged) {
+            DrainInFlightWrites(inFlight, (std::max)(1u, writeWindow.load()) - 1, failed);
+
+            bool finishes = completionId != 0 || coalesced;
+            TraceScope scope("winrt.WriteWithoutResponse", traceId);
+            written = StartUnacknowledgedWrite(characteristic, fragment, id, lane, messages, completionId, inFlight);
+            handedOff = written && finishes;
+        }
+        else {
+            // Responses are ordered, so earlier writes without response must complete first
+            DrainInFlightWrites(inFlight, 0, failed);
+
+            auto started = std::chrono::steady_clock::now();
+            {
+                // Covers the stack, the air time and the device response
+                TraceScope scope("winrt.WriteValueAsync", traceId);
+                written = WriteFragment(characteristic, fragment);
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+
+            if (written) {
+                RecordWriteLatency(elapsed);
+            }
+        }
+
+        if (written) {
+            metrics[METRIC_FRAGMENTS_WRITTEN]++;
+            metrics[METRIC_BYTES_WRITTEN] += (int64_t)fragment.size();
+        }
+        else {
+            metrics[METRIC_WRITE_FAILURES]++;
+        }
+
+        // Coalesced messages already left the queue, complete them unless a drain will
+        if (!handedOff && completionId != 0) {
+            auto completion = TakeCompletion(completionId);
+            if (completion) {
+                if (coalesced && written) {
+                    metrics[METRIC_SENT_CONTROL + lane] += messages;
+                }
+                completion(coalesced && written);
+            }
+        }
+
+        TuneWriter(std::chrono::steady_clock::now());
+
+        lock.lock();
+
+        if (coalesced) {
+            continue;
+        }
+
+        // The queue may have been flushed by cleanup while writing
+        if (queue.empty() || queue.front().id != id) {
+            continue;
+        }
+
+        OutboundMessage& current = queue.front();
+        current.offset += length;
+
+        if (!written || current.offset >= current.data.size()) {
+            // A handed-off last write leaves the failure marks of earlier fragments, and the verdict, to the drain
+            bool earlierFailed = !handedOff && failed.erase(id) > 0;
+            bool success = written && !earlierFailed;
+            if (!handedOff) {
+                ForgetInFlightMessage(inFlight, id);
+            }
+
+            auto onComplete = std::move(current.onComplete);
+            queue.pop_front();
+            if (success && !handedOff) {
+                metrics[METRIC_SENT_CONTROL + lane]++;
+            }
+
+            lock.unlock();
+            if (onComplete) {
+                onComplete(success);
+            }
+            lock.lock();
+        }
+    }
+
+    lock.unlock();
+    AbandonInFlightWrites(inFlight);
+    exited.set_value();
+}
+
+// Function to start the writer thread if it is not running, outboundMutex must be held
+void StartOutboundWriterLocked() {
+    if (outboundRunning) {
+        return;
+    }
+
+    outboundRunning = true;
+    outboundGeneration++;
+
+    std::promise<void> exited;
+    outboundWriterExited = exited.get_future();
+    outboundWriter = StartLibraryThread([generation = outboundGeneration, exited = std::move(exited)]() mutable {
+        OutboundWriterLoop(generation, std::move(exited));
+    });
+}
+
+// Function to start the writer ahead of the first message, so the first write does not pay for the thread
+void StartOutboundWriter() {
+    std::lock_guard<std::mutex> lock(outboundMutex);
+    StartOutboundWriterLocked();
+}
+
+// Function to queue a message in one of the outbound lanes, the writer thread is started if it was stopped
+bool EnqueueOutbound(std::vector<uint8_t>&& data, int priority, std::optional<std::chrono::steady_clock::time_point> deadline, std::function<void(bool)> onComplete, bool windowed = false, uint64_t traceId = 0, bool interruptible = false) {
+    if (data.empty() || priority < 0 || priority >= PRIORITY_COUNT) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(outboundMutex);
+
+        // A stopped writer was already handed over to StopOutboundWriter
+        StartOutboundWriterLocked();
+
+        outboundQueues[priority].push_back({ nextOutboundId++, std::move(data), 0, deadline, std::move(onComplete), windowed, traceId, traceId ? TraceNow() : 0, interruptible });
+    }
+
+    outboundCondition.notify_one();
+    return true;
+}
+
+// Function to stop the writer thread and fail everything still queued
+// Returns false if the writer was stuck in a write past the timeout, it is then detached and exits on its own
+bool StopOutboundWriter(std::chrono::milliseconds timeout) {
+    bool stopped = true;
+    std::vector<std::function<void(bool)>> pending;
+    std::thread writer;
+    std::future<void> writerExited;
+
+    {
+        std::lock_guard<std::mutex> lock(outboundMutex);
+        outboundRunning = false;
+
+        // Take the thread over, completions may already start a new writer
+        writer = std::move(outboundWriter);
+        writerExited = std::move(outboundWriterExited);
+
+        for (auto& queue : outboundQueues) {
+            for (auto& message : queue) {
+                if (message.onComplete) {
+                    pending.push_back(std::move(message.onComplete));
+                }
+            }
+            queue.clear();
+        }
+
+        // Coalesced and in-flight messages are off the queue, fail them here too so callers never wait on a stuck write
+        for (auto& detached : detachedCompletions) {
+            pending.push_back(std::move(detached.second));
+        }
+        detachedCompletions.clear();
+    }
+
+    outboundCondition.notify_all();
+
+    if (writer.joinable()) {
+        // Stopped from inside a completion of the writer itself, it exits once this returns
+        bool self = writer.get_id() == std::this_thread::get_id();
+
+        if (!self && writerExited.valid() && writerExited.wait_for(timeout) == std::future_status::ready) {
+            writer.join();
+        }
+        else {
+            writer.detach();
+            stopped = self;
+        }
+    }
+
+    for (auto& onComplete : pending) {
+        onComplete(false);
+    }
+
+    return stopped;
+}
+
+// Function to follow the negotiated MTU of the connected device
+void TrackMaxPduSize() {
+    try {
+        auto device = GetConnectedDevice();
+        if (!device) {
+            return;
+        }
+
+        auto session = GattSession::FromDeviceIdAsync(device->BluetoothDeviceId()).get();
+        if (session == nullptr) {
+            return;
+        }
+
+        auto update = [](GattSession const& sender) {
+            // MaxPduSize includes the 3 byte ATT header of a write request
+            uint32_t size = (std::max)(20u, (uint32_t)sender.MaxPduSize() - 3u);
+            fragmentSize.store(size);
+            metrics[METRIC_FRAGMENT_SIZE].store(size);
+        };
+
+        update(session);
+        auto token = session.MaxPduSizeChanged([update](GattSession const& sender, auto&&) {
+            update(sender);
+        });
+
+        // Teardown may have run meanwhile, the session then belongs to no connection
+        bool current;
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            current = connectedDevice == device;
+            if (current) {
+                gattSession = std::make_shared<GattSession>(session);
+                maxPduSizeChangedToken = token;
+            }
+        }
+
+        if (!current) {
+            session.MaxPduSizeChanged(token);
+            session.Close();
+        }
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Unable to read GATT session MTU: " << winrt::to_string(e.message()) << std::endl;
+    }
+}
+
+// Struct to hold a logical channel multiplexed over the UART session
+struct Channel {
+    bool open = false;
+    int priority = PRIORITY_INTERACTIVE;
+    uint32_t credit = 0;   // Frames of this channel that may wait in the outbound lanes at once
+    uint32_t inFlight = 0;
+    size_t maxPendingBytes = 0;
+    size_t pendingBytes = 0;
+    std::deque<std::vector<uint8_t>> pending; // Encoded frames waiting for credit
+};
+
+// Channel frames are [channel id][payload length][payload], a frame never spans two writes
+constexpr int CHANNEL_COUNT = 256;
+constexpr size_t CHANNEL_HEADER_SIZE = 2;
+constexpr size_t CHANNEL_MAX_PAYLOAD = 255;
+
+// Channel state, everything is guarded by channelMutex
+std::mutex channelMutex;
+Channel channels[CHANNEL_COUNT];
+int channelCursor = 0;
+std::vector<uint8_t> channelInbound; // Received bytes of an incomplete frame
+std::atomic<int> openChannelCount{ 0 };
+
+void OnChannelFrameWritten(int channelId, bool success);
+
+// Function to move frames from the channels into the outbound lanes, round robin and within each channel's credit
+// Must be called with channelMutex held, so frames of one channel are queued in order
+void PumpChannels() {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+
+        // One frame per channel per pass, so a busy channel can not starve the others
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            int channelId = (channelCursor + i) % CHANNEL_COUNT;
+            Channel& channel = channels[channelId];
+            if (!channel.open || channel.pending.empty() || channel.inFlight >= channel.credit) {
+                continue;
+            }
+
+            std::vector<uint8_t> frame = std::move(channel.pending.front());
+            channel.pending.pop_front();
+            channel.pendingBytes -= frame.size() - CHANNEL_HEADER_SIZE;
+            channel.inFlight++;
+
+            EnqueueOutbound(std::move(frame), channel.priority, std::nullopt, [channelId](bool success) {
+                OnChannelFrameWritten(channelId, success);
+            });
+            progress = true;
+        }
+
+        channelCursor = (channelCursor + 1) % CHANNEL_COUNT;
+    }
+}
+
+// Function to return credit once a frame has been written, or failed
+void OnChannelFrameWritten(int channelId, bool success) {
+    metrics[success ? METRIC_CHANNEL_FRAMES_SENT : METRIC_CHANNEL_FRAMES_FAILED]++;
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    Channel& channel = channels[channelId];
+    if (channel.inFlight > 0) {
+        channel.inFlight--;
+    }
+    PumpChannels();
+}
+
+// Function to split data into frames for a channel, returns false when the channel is closed or its buffer is full
+bool WriteChannel(int channelId, const uint8_t* data, size_t length) {
+    if (channelId < 0 || channelId >= CHANNEL_COUNT || length == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    Channel& channel = channels[channelId];
+
+    if (!channel.open) {
+        return false;
+    }
+
+    // Per channel flow control, the caller has to back off instead of growing the queue
+    if (channel.pendingBytes + length > channel.maxPendingBytes) {
+        metrics[METRIC_CHANNEL_REJECTED]++;
+        return false;
+    }
+
+    // Frames must fit a single write so higher lanes never split them
+    size_t maxPayload = (std::min)(CHANNEL_MAX_PAYLOAD, (size_t)fragmentSize.load() - CHANNEL_HEADER_SIZE);
+
+    for (size_t offset = 0; offset < length; offset += maxPayload) {
+        size_t payload = (std::min)(maxPayload, length - offset);
+
+        std::vector<uint8_t> frame;
+        frame.reserve(CHANNEL_HEADER_SIZE + payload);
+        frame.push_back((uint8_t)channelId);
+        frame.push_back((uint8_t)payload);
+        frame.insert(frame.end(), data + offset, data + offset + payload);
+
+        channel.pending.push_back(std::move(frame));
+        channel.pendingBytes += payload;
+    }
+
+    PumpChannels();
+    return true;
+}
+
+// Function to split received bytes into complete channel frames, partial frames are kept for the next notification
+std::vector<std::pair<int, std::vector<uint8_t>>> DemultiplexChannels(const std::vector<uint8_t>& data) {
+    std::vector<std::pair<int, std::vector<uint8_t>>> frames;
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    channelInbound.insert(channelInbound.end(), data.begin(), data.end());
+
+    size_t offset = 0;
+    while (channelInbound.size() - offset >= CHANNEL_HEADER_SIZE) {
+        int channelId = channelInbound[offset];
+        size_t payload = channelInbound[offset + 1];
+        if (channelInbound.size() - offset < CHANNEL_HEADER_SIZE + payload) {
+            break;
+        }
+
+        auto begin = channelInbound.begin() + offset + CHANNEL_HEADER_SIZE;
+        if (channels[channelId].open && payload > 0) {
+            frames.emplace_back(channelId, std::vector<uint8_t>(begin, begin + payload));
+        }
+        offset += CHANNEL_HEADER_SIZE + payload;
+    }
+
+    channelInbound.erase(channelInbound.begin(), channelInbound.begin() + offset);
+    metrics[METRIC_CHANNEL_FRAMES_RECEIVED] += (int64_t)frames.size();
+    return frames;
+}
+
+// Function to deliver received channel frames to Java `onChannelData`
+void CallJavaChannelData(JNIEnv* env, jobject javaObject, const std::vector<std::pair<int, std::vector<uint8_t>>>& frames) {
+    if (env == nullptr || javaObject == nullptr || frames.empty()) {
+        return;
+    }
+
+    jmethodID methodId = GetCallback(env, javaObject, "onChannelData", "(I[B)V");
+    if (!methodId) {
+        std::cout << "Failed to find Java method: onChannelData" << std::endl;
+        return;
+    }
+
+    for (const auto& frame : frames) {
+        jbyteArray payload = env->NewByteArray((jsize)frame.second.size());
+        if (!payload) {
+            env->ExceptionClear();
+            return;
+        }
+
+        env->SetByteArrayRegion(payload, 0, (jsize)frame.second.size(), reinterpret_cast<const jbyte*>(frame.second.data()));
+        env->CallVoidMethod(javaObject, methodId, (jint)frame.first, payload);
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+        env->DeleteLocalRef(payload);
+    }
+}
+
+// Function to drop all channel state, e.g. when the connection goes away
+void ResetChannels() {
+    std::lock_guard<std::mutex> lock(channelMutex);
+
+    for (auto& channel : channels) {
+        channel.inFlight = 0;
+        channel.pending.clear();
+        channel.pendingBytes = 0;
+    }
+    channelInbound.clear();
+}
+
+// Function to drop the bytes of an incomplete inbound frame, the [id][len] format cannot resync after a gap
+void ResetChannelInbound() {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    channelInbound.clear();
+}
+
+// Function to run a blocking teardown step on its own thread, returns false if it missed the deadline
+bool RunWithDeadline(std::function<void()> step, std::chrono::milliseconds timeout) {
+    auto done = std::make_shared<std::promise<void>>();
+    auto finished = done->get_future();
+
+    // Detached, a step that hangs on a dead radio is left behind and keeps the module loaded until it returns
+    StartLibraryThread([step = std::move(step), done]() {
+        try {
+            init_apartment();
+            step();
+        }
+        catch (const winrt::hresult_error& ex) {
+            std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "Standard Exception: " << ex.what() << std::endl;
+        }
+        done->set_value();
+    }).detach();
+
+    return finished.wait_for(timeout) == std::future_status::ready;
+}
+
+// Function to tear down the connection, every step has its own deadline and independent steps overlap
+// With `expected` set only that device is torn down, a late event of an earlier device leaves the current one alone
+// Returns the TeardownFlag bits of the steps that did not finish cleanly
+int TeardownConnection(std::chrono::milliseconds stepTimeout, const BluetoothLEDevice* expected = nullptr) {
+    int unclean = TEARDOWN_CLEAN;
+
+    // Take ownership first so other threads see the connection as gone right away
+    std::shared_ptr<BluetoothLEDevice> device;
+    std::shared_ptr<GattSession> session;
+    std::shared_ptr<GattCharacteristic> tx;
+    std::shared_ptr<GattCharacteristic> rx;
+    winrt::event_token valueToken{};
+    winrt::event_token statusToken{};
+    winrt::event_token pduToken{};
+    {
+        std::lock_guard<std::mutex> lock(connectionMutex);
+        if (expected && (!connectedDevice || *connectedDevice != *expected)) {
+            return TEARDOWN_CLEAN;
+        }
+
+        device = std::move(connectedDevice);
+        session = std::move(gattSession);
+        tx = std::move(txCharacteristic);
+        rx = std::move(rxCharacteristic);
+        valueToken = std::exchange(valueChangedToken, {});
+        statusToken = std::exchange(connectionStatusChangedToken, {});
+        pduToken = std::exchange(maxPduSizeChangedToken, {});
+    }
+
+    // Stop notification, started first so it runs while the writer is stopped
+    winrt::Windows::Foundation::IAsyncOperation<GattCommunicationStatus> unsubscribe{ nullptr };
+    if (tx) {
+        try {
+            unsubscribe = tx->WriteClientCharacteristicConfigurationDescriptorAsync(GattClientCharacteristicConfigurationDescriptorValue::None);
+        }
+        catch (const winrt::hresult_error& ex) {
+            std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+            unclean |= TEARDOWN_UNSUBSCRIBE;
+        }
+    }
+
+    // Stop the writer thread, queued messages are failed, channels first so they do not queue more frames
+    ResetChannels();
+    if (!StopOutboundWriter(stepTimeout)) {
+        unclean |= TEARDOWN_WRITER;
+    }
+
+    if (unsubscribe) {
+        try {
+            if (unsubscribe.wait_for(stepTimeout) == winrt::Windows::Foundation::AsyncStatus::Completed && unsubscribe.GetResults() == GattCommunicationStatus::Success) {
+                std::cout << "Notifications stopped successfully." << std::endl;
+            }
+            else {
+                unsubscribe.Cancel();
+                unclean |= TEARDOWN_UNSUBSCRIBE;
+            }
+        }
+        catch (const winrt::hresult_error& ex) {
+            std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+            unclean |= TEARDOWN_UNSUBSCRIBE;
+        }
+    }
+
+    // Revoke event handlers, no new callback starts after this point; cleanup waits for running ones
+    try {
+        if (tx && valueToken) {
+            tx->ValueChanged(valueToken);
+        }
+        if (device && statusToken) {
+            device->ConnectionStatusChanged(statusToken);
+        }
+        if (session && pduToken) {
+            session->MaxPduSizeChanged(pduToken);
+        }
+    }
+    catch (const winrt::hresult_error& ex) {
+        std::cerr << "WinRT Exception: " << winrt::to_string(ex.message()) << std::endl;
+        unclean |= TEARDOWN_HANDLERS;
+    }
+
+    // Stop connection, Close can block on an unresponsive stack
+    if (device || session) {
+        bool closed = RunWithDeadline([device, session]() {
+            if (session) {
+                session->Close();
+            }
+            if (device) {
+                device->Close();
+            }
+        }, stepTimeout);
+
+        if (!closed) {
+            unclean |= TEARDOWN_CLOSE;
+        }
+    }
+
+    if (unclean != TEARDOWN_CLEAN) {
+        metrics[METRIC_UNCLEAN_TEARDOWNS]++;
+        std::cerr << "Teardown left unclean steps: " << unclean << std::endl;
+    }
+
+    return unclean;
+}
+
+// Function to clean up the connection and the global reference
+int cleanup(JNIEnv* env, std::chrono::milliseconds stepTimeout = DEFAULT_TEARDOWN_TIMEOUT) {
+    if (env == nullptr) {
+        return TEARDOWN_CLEAN; // Fail-safe: No valid environment
+    }
+
+    int unclean = TeardownConnection(stepTimeout);
+
+    uartServiceGuid.reset();
+    rxUuid.reset();
+    txUuid.reset();
+
+    // Handlers entered before this see them closed and return, running ones still use globalObj
+    handlersOpen.store(false);
+    auto handlersDeadline = std::chrono::steady_clock::now() + stepTimeout;
+    while (activeHandlers.load() > handlerDepth && std::chrono::steady_clock::now() < handlersDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bool handlersIdle = activeHandlers.load() == 0;
+   
+    if (globalObj != nullptr) {
+        if (handlersIdle) {
+            env->DeleteGlobalRef(globalObj);  // Delete the global reference when done
+        }
+        else {
+            // A handler is still inside Java, leaking one reference is safer than freeing it under the handler
+            std::cerr << "Event handler still running, keeping the global reference alive." << std::endl;
+            unclean |= TEARDOWN_HANDLERS;
+        }
+        globalObj = nullptr;  // Set to nullptr to avoid dangling reference
+    }
+
+    return unclean;
+}
+
+// Calling java method from the class
+void CallJavaMethod(JNIEnv* env, jobject javaObject, const char* methodName, const char* methodSig, const char* message) {
+    try {
+        if (env == nullptr) {
+            std::cout << "env is null" << std::endl;
+            return;
+        }
+
+        if (javaObject == nullptr) {
+            std::cout << "javaObject is null" << std::endl;
+            return;
+        }
+
+
+        // Resolved once in JNI_OnLoad for the known callbacks
+        jmethodID methodId = GetCallback(env, javaObject, methodName, methodSig);
+        if (!methodId) {
+            std::cout << "Failed to find Java method: " << methodName << std::endl;
+            return;
+        }
+
+        // Convert the message to a Java string
+        jstring javaMessage = env->NewStringUTF(message);
+        if (!javaMessage) {
+            std::cout << "Failed to create Java string from message." << std::endl;
+            return;
+        }
+
+        // Call the Java method
+        env->CallVoidMethod(javaObject, methodId, javaMessage);
+
+        // Delete local references
+        env->DeleteLocalRef(javaMessage);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception in CallJavaMethod: " << e.what() << std::endl;
+    }
+}
+
+// Function to handle connection status change
+void OnConnectionStatusChanged(JNIEnv* env, jobject javaObject, BluetoothLEDevice const& sender, winrt::Windows::Foundation::IInspectable const& args) {
+    try {
+        // Get connection status of the device
+        auto status = sender.ConnectionStatus();
+
+        if (status == BluetoothConnectionStatus::Disconnected) {
+            // Same path as disconnectDevice: stop the writer, revoke the handlers and close the device
+            TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT, &sender);
+            uartServiceGuid.reset();
+            rxUuid.reset();
+            txUuid.reset();
+
+            // A frame cut off by the link loss must not prefix the first frame after a reconnect
+            ResetChannelInbound();
+
+            std::wcout << L"Device disconnected. Checking last GATT error..." << std::endl;
+            // auto error = sender.DeviceInformation().Pairing().ProtectionLevel();  // Example for pairing error
+            // std::wcout << L"Last known error: " << static_cast<int>(error) << std::endl;
+        }
+
+        // Check connection status and print appropriate message
+        std::wcout << L"Connection Status Changed: " << (status == BluetoothConnectionStatus::Connected ? L"Connected" : L"Disconnected") << std::endl;
+
+        // Call Java `onDeviceDisconnected`
+        if (status == BluetoothConnectionStatus::Connected) {
+            CallJavaMethod(env, javaObject, "onDeviceConnected", "(Ljava/lang/String;)V", "Device Connected");
+        }
+        else {
+            CallJavaMethod(env, javaObject, "onDeviceDisconnected", "(Ljava/lang/String;)V", "Device Disconnected");
+        }
+
+        // Get JavaVM from env
+        JavaVM* jvm;
+        env->GetJavaVM(&jvm);
+
+        // Detach from the thread after use
+        jvm->DetachCurrentThread();
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception while handling connection status: " << e.message().c_str() << std::endl;
+    }
+}
+
+// Size of the header in front of every batched notification: timestamp (8), session (4), channel (2), length (2)
+constexpr size_t BATCH_RECORD_HEADER = 16;
+
+// Smallest batch buffer, large enough for a few notifications at the maximum ATT MTU
+constexpr size_t MIN_BATCH_BUFFER_BYTES = 4096;
+
+// Channel recorded for notifications of the raw TX stream
+constexpr int16_t BATCH_RAW_CHANNEL = -1;
+
+// Struct to hold one batch buffer, the direct ByteBuffer wraps the memory so it is created only once
+struct NotificationBuffer {
+    std::unique_ptr<uint8_t[]> data;
+    size_t used = 0;
+    int count = 0;
+    int64_t firstAt = 0;
+    jobject byteBuffer = nullptr; // Global reference to the direct ByteBuffer over `data`
+};
+
+// Notification batching state, everything is guarded by batchMutex
+std::mutex batchMutex;
+std::condition_variable batchCondition;
+NotificationBuffer batchBuffers[2];
+int batchFilling = 0; // Index of the buffer producers append to, the other one is being delivered
+size_t batchCapacity = 0;
+int batchMaxCount = 0;
+std::chrono::microseconds batchMaxLatency{ 0 };
+bool batchRunning = false;
+std::thread batchDelivery;
+jobject batchTarget = nullptr; // Own global reference, cleanup may drop globalObj while a batch is delivered
+bool batchStopDeferred = false; // Stopped from inside onNotificationBatch, the delivery thread releases everything itself
+JavaVM* batchJvm = nullptr;
+
+// Checked without the lock on every notification
+std::atomic<bool> batchingEnabled{ false };
+
+// Session id recorded with every batched notification, increases with every subscription
+std::atomic<int32_t> notificationSession{ 0 };
+
+// Function to append one notification to the filling batch, returns false if batching is off or the record was dropped
+bool BatchNotification(int16_t channel, const uint8_t* payload, size_t length) {
+    if (!batchingEnabled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(batchMutex);
+    if (!batchRunning) {
+        return false;
+    }
+
+    NotificationBuffer& buffer = batchBuffers[batchFilling];
+    size_t recordSize = BATCH_RECORD_HEADER + length;
+
+    // Both buffers are busy, Java is not keeping up; drop instead of stalling the notification thread
+    if (length > 0xFFFF || buffer.used + recordSize > batchCapacity) {
+        metrics[METRIC_NOTIFICATIONS_DROPPED]++;
+        return true;
+    }
+
+    int64_t now = TraceNow();
+    int32_t session = notificationSession.load();
+    uint16_t size = (uint16_t)length;
+
+    uint8_t* record = buffer.data.get() + buffer.used;
+    std::memcpy(record, &now, sizeof(now));
+    std::memcpy(record + 8, &session, sizeof(session));
+    std::memcpy(record + 12, &channel, sizeof(channel));
+    std::memcpy(record + 14, &size, sizeof(size));
+    std::memcpy(record + BATCH_RECORD_HEADER, payload, length);
+
+    buffer.used += recordSize;
+    buffer.count++;
+
+    // Wake the delivery thread to start the latency clock, and again once the batch is full
+    if (buffer.count == 1) {
+        buffer.firstAt = now;
+        batchCondition.notify_one();
+    }
+    else if (buffer.count >= batchMaxCount || buffer.used + BATCH_RECORD_HEADER + fragmentSize.load() > batchCapacity) {
+        batchCondition.notify_one();
+    }
+
+    return true;
+}
+
+// Function to release the batch buffers and the Java target, batchMutex must be held and no batch may be in Java
+void ReleaseBatchBuffersLocked(JNIEnv* env) {
+    for (auto& buffer : batchBuffers) {
+        if (buffer.byteBuffer != nullptr) {
+            env->DeleteGlobalRef(buffer.byteBuffer);
+        }
+        buffer = NotificationBuffer{};
+    }
+
+    if (batchTarget != nullptr) {
+        env->DeleteGlobalRef(batchTarget);
+        batchTarget = nullptr;
+    }
+    batchCapacity = 0;
+}
+
+// Thread function to deliver batches to Java `onNotificationBatch`, the thread stays attached for its whole life
+void NotificationDeliveryLoop() {
+    JNIEnv* env = nullptr;
+    if (batchJvm->AttachCurrentThreadAsDaemon((void**)&env, nullptr) != JNI_OK) {
+        std::cerr << "Failed to attach notification delivery thread to JVM" << std::endl;
+        return;
+    }
+
+    jmethodID methodId = GetCallback(env, batchTarget, "onNotificationBatch", "(Ljava/nio/ByteBuffer;I)V");
+    if (!methodId) {
+        std::cout << "Failed to find Java method: onNotificationBatch" << std::endl;
+    }
+
+    std::unique_lock<std::mutex> lock(batchMutex);
+    while (true) {
+        NotificationBuffer* filling = &batchBuffers[batchFilling];
+
+        // Wait for a full batch or for the oldest notification to reach the latency bound
+        if (filling->count == 0) {
+            batchCondition.wait(lock, [] { return !batchRunning || batchBuffers[batchFilling].count > 0; });
+        }
+        else {
+            auto deadline = std::chrono::steady_clock::time_point(std::chrono::microseconds(filling->firstAt)) + batchMaxLatency;
+            batchCondition.wait_until(lock, deadline, [filling] {
+                return !batchRunning || filling->count >= batchMaxCount || filling->used + BATCH_RECORD_HEADER + fragmentSize.load() > batchCapacity;
+            });
+        }
+
+        filling = &batchBuffers[batchFilling];
+        if (filling->count == 0) {
+            if (!batchRunning) {
+                break;
+            }
+            continue;
+        }
+
+        bool due = !batchRunning || filling->count >= batchMaxCount || filling->used + BATCH_RECORD_HEADER + fragmentSize.load() > batchCapacity
+            || TraceNow() - filling->firstAt >= batchMaxLatency.count();
+        if (!due) {
+            continue;
+        }
+
+        // Swap buffers so producers keep appending while this batch is in Java
+        NotificationBuffer& delivering = *filling;
+        batchFilling ^= 1;
+        lock.unlock();
+
+        if (methodId) {
+            env->CallVoidMethod(batchTarget, methodId, delivering.byteBuffer, (jint)delivering.count);
+            if (env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+            }
+        }
+
+        metrics[METRIC_NOTIFICATION_BATCHES]++;
+        metrics[METRIC_NOTIFICATIONS_BATCHED] += delivering.count;
+
+        lock.lock();
+        delivering.used = 0;
+        delivering.count = 0;
+        delivering.firstAt = 0;
+    }
+
+    // Stopped from inside the callback, nobody joins this thread; release once the last batch left Java
+    if (batchStopDeferred) {
+        batchStopDeferred = false;
+        ReleaseBatchBuffersLocked(env);
+        if (batchDelivery.joinable()) {
+            batchDelivery.detach();
+        }
+    }
+
+    JavaVM* jvm = batchJvm;
+    lock.unlock();
+    jvm->DetachCurrentThread();
+}
+
+// Function to flush what is left, stop the delivery thread and release the buffers
+void StopNotificationBatching(JNIEnv* env) {
+    batchingEnabled.store(false);
+
+    std::thread delivery;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batchRunning = false;
+
+        // Called from inside onNotificationBatch, Java still holds the buffer; the loop releases it after the callback
+        if (batchDelivery.get_id() == std::this_thread::get_id()) {
+            batchStopDeferred = true;
+            return;
+        }
+
+        delivery = std::move(batchDelivery);
+    }
+    batchCondition.notify_all();
+
+    if (delivery.joinable()) {
+        delivery.join();
+    }
+
+    std::lock_guard<std::mutex> lock(batchMutex);
+    ReleaseBatchBuffersLocked(env);
+}
+
+// Function to start batching, a batch is flushed at `maxCount` notifications or once its oldest one waited `maxLatency`
+bool StartNotificationBatching(JNIEnv* env, jobject javaObject, int maxCount, std::chrono::microseconds maxLatency, size_t bufferBytes) {
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (batchDelivery.get_id() == std::this_thread::get_id()) {
+            std::cerr << "Error: batching cannot be reconfigured from inside onNotificationBatch." << std::endl;
+            return false;
+        }
+    }
+
+    StopNotificationBatching(env);
+
+    std::lock_guard<std::mutex> lock(batchMutex);
+    for (auto& buffer : batchBuffers) {
+        buffer.data.reset(new uint8_t[bufferBytes]);
+
+        jobject direct = env->NewDirectByteBuffer(buffer.data.get(), (jlong)bufferBytes);
+        if (!direct) {
+            env->ExceptionClear();
+            std::cerr << "Failed to create direct ByteBuffer for notification batching" << std::endl;
+            for (auto& created : batchBuffers) {
+                if (created.byteBuffer != nullptr) {
+                    env->DeleteGlobalRef(created.byteBuffer);
+                }
+                created = NotificationBuffer{};
+            }
+            return false;
+        }
+
+        buffer.byteBuffer = env->NewGlobalRef(direct);
+        env->DeleteLocalRef(direct);
+    }
+
+    env->GetJavaVM(&batchJvm);
+    batchTarget = env->NewGlobalRef(javaObject);
+    batchFilling = 0;
+    batchCapacity = bufferBytes;
+    batchMaxCount = maxCount;
+    batchMaxLatency = maxLatency;
+    batchRunning = true;
+    batchDelivery = StartLibraryThread(NotificationDeliveryLoop);
+    batchingEnabled.store(true);
+    return true;
+}
+
+// Field types of a binary frame schema (must match BluetoothBLE.FIELD_*)
+enum FieldType : int {
+    FIELD_UINT8 = 0,
+    FIELD_INT8,
+    FIELD_UINT16,
+    FIELD_INT16,
+    FIELD_UINT32,
+    FIELD_INT32,
+    FIELD_FLOAT32,
+    FIELD_TYPE_COUNT
+};
+
+// Struct to hold one field of a frame, decoded as value * scale + offset
+struct FrameField {
+    FieldType type;
+    size_t offset; // Byte offset inside the frame
+    float scale;
+    float bias;
+};
+
+// Struct to hold a decoder for one subscription, received bytes are collected until a batch is complete
+struct FrameDecoder {
+    std::vector<FrameField> fields;
+    size_t frameSize = 0;
+    size_t batchFrames = 1;
+    bool bigEndian = false;
+    bool shortOutput = false; // Raw 16 bit samples as short[], only when every field is 16 bit
+    std::vector<uint8_t> pending;
+    std::vector<uint16_t> scratch; // Gathered 16 bit column, reused between batches
+};
+
+// Struct to hold a decoded columnar batch, column `f` starts at f * frames
+struct DecodedBatch {
+    int subscription;
+    int frames;
+    int fieldCount;
+    std::vector<float> floats;
+    std::vector<int16_t> shorts;
+};
+
+// Subscription of the raw TX stream, channels use their channel id
+constexpr int RAW_SUBSCRIPTION = -1;
+
+// Decoders keyed by subscription, guarded by decoderMutex
+std::mutex decoderMutex;
+std::unordered_map<int, FrameDecoder> frameDecoders;
+std::atomic<int> decoderCount{ 0 };
+
+// Function to get the size of a field type in bytes
+size_t FieldSize(FieldType type) {
+    switch (type) {
+    case FIELD_UINT8:
+    case FIELD_INT8:
+        return 1;
+    case FIELD_UINT16:
+    case FIELD_INT16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+// Function to read a field of up to 4 bytes as an unsigned value in the frame's byte order
+uint32_t ReadFieldBits(const uint8_t* data, size_t size, bool bigEndian) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        size_t shift = bigEndian ? (size - 1 - i) * 8 : i * 8;
+        value |= (uint32_t)data[i] << shift;
+    }
+    return value;
+}
+
+// Function to convert a gathered 16 bit column to floats, eight samples per step with SSE2
+void Convert16BitColumn(const uint16_t* source, size_t count, bool isSigned, bool swapBytes, float scale, float bias, float* target) {
+    size_t i = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scales = _mm_set1_ps(scale);
+    const __m128 biases = _mm_set1_ps(bias);
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        if (swapBytes) {
+            raw = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        }
+
+        // Widen to 32 bit, sign extension is done by an arithmetic shift of the high half
+        __m128i low = isSigned ? _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16) : _mm_unpacklo_epi16(raw, zero);
+        __m128i high = isSigned ? _mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16) : _mm_unpackhi_epi16(raw, zero);
+
+        _mm_storeu_ps(target + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(low), scales), biases));
+        _mm_storeu_ps(target + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(high), scales), biases));
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint16_t raw = swapBytes ? (uint16_t)((source[i] << 8) | (source[i] >> 8)) : source[i];
+        float value = isSigned ? (float)(int16_t)raw : (float)raw;
+        target[i] = value * scale + bias;
+    }
+}
+
+// Function to copy a gathered 16 bit column as raw shorts, eight samples per step with SSE2
+void Copy16BitColumn(const uint16_t* source, size_t count, bool swapBytes, int16_t* target) {
+    size_t i = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    for (; i + 8 <= count; i += 8) {
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        if (swapBytes) {
+            raw = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), raw);
+    }
+#endif
+
+    for (; i < count; i++) {
+        target[i] = (int16_t)(swapBytes ? (uint16_t)((source[i] << 8) | (source[i] >> 8)) : source[i]);
+    }
+}
+
+// Function to decode `frames` complete frames into columns
+void DecodeFrames(FrameDecoder& decoder, const uint8_t* data, size_t frames, DecodedBatch& batch) {
+    size_t fieldCount = decoder.fields.size();
+    batch.frames = (int)frames;
+    batch.fieldCount = (int)fieldCount;
+
+    if (decoder.shortOutput) {
+        batch.shorts.resize(frames * fieldCount);
+    }
+    else {
+        batch.floats.resize(frames * fieldCount);
+    }
+
+    // Host is little endian, 16 bit columns only need a swap for big endian frames
+    bool swapBytes = decoder.bigEndian;
+
+    for (size_t f = 0; f < fieldCount; f++) {
+        const FrameField& field = decoder.fields[f];
+        const uint8_t* source = data + field.offset;
+
+        if (field.type == FIELD_UINT16 || field.type == FIELD_INT16) {
+            // Gather the strided column first so the conversion runs on contiguous samples
+            decoder.scratch.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                std::memcpy(&decoder.scratch[i], source + i * decoder.frameSize, sizeof(uint16_t));
+            }
+
+            if (decoder.shortOutput) {
+                Copy16BitColumn(decoder.scratch.data(), frames, swapBytes, batch.shorts.data() + f * frames);
+            }
+            else {
+                Convert16BitColumn(decoder.scratch.data(), frames, field.type == FIELD_INT16, swapBytes, field.scale, field.bias, batch.floats.data() + f * frames);
+            }
+            continue;
+        }
+
+        float* target = batch.floats.data() + f * frames;
+        size_t size = FieldSize(field.type);
+
+        for (size_t i = 0; i < frames; i++) {
+            uint32_t bits = ReadFieldBits(source + i * decoder.frameSize, size, decoder.bigEndian);
+            float value = 0;
+
+            switch (field.type) {
+            case FIELD_UINT8: value = (float)(uint8_t)bits; break;
+            case FIELD_INT8: value = (float)(int8_t)bits; break;
+            case FIELD_UINT32: value = (float)bits; break;
+            case FIELD_INT32: value = (float)(int32_t)bits; break;
+            case FIELD_FLOAT32: std::memcpy(&value, &bits, sizeof(value)); break;
+            default: break;
+            }
+
+            target[i] = value * field.scale + field.bias;
+        }
+    }
+}
+
+// Function to feed received bytes to the decoder of a subscription, returns false if it has none
+// Complete batches are appended to `batches`, remaining bytes wait for the next notification
+bool FeedFrameDecoder(int subscription, const std::vector<uint8_t>& data, std::vector<DecodedBatch>& batches) {
+    std::lock_guard<std::mutex> lock(decoderMutex);
+
+    auto found = frameDecoders.find(subscription);
+    if (found == frameDecoders.end()) {
+        return false;
+    }
+
+    FrameDecoder& decoder = found->second;
+    decoder.pending.insert(decoder.pending.end(), data.begin(), data.end());
+
+    size_t batchBytes = decoder.frameSize * decoder.batchFrames;
+    size_t offset = 0;
+
+    while (decoder.pending.size() - offset >= batchBytes) {
+        DecodedBatch batch{ subscription };
+        DecodeFrames(decoder, decoder.pending.data() + offset, decoder.batchFrames, batch);
+        batches.push_back(std::move(batch));
+        offset += batchBytes;
+    }
+
+    decoder.pending.erase(decoder.pending.begin(), decoder.pending.begin() + offset);
+    return true;
+}
+
+// Function to deliver decoded batches to Java `onSensorBatch` (float[]) or `onSensorBatchRaw` (short[]), one upcall per batch
+void CallJavaSensorBatches(JNIEnv* env, jobject javaObject, const std::vector<DecodedBatch>& batches) {
+    if (env == nullptr || javaObject == nullptr || batches.empty()) {
+        return;
+    }
+
+    jmethodID floatMethod = GetCallback(env, javaObject, "onSensorBatch", "(I[FII)V");
+    jmethodID shortMethod = GetCallback(env, javaObject, "onSensorBatchRaw", "(I[SII)V");
 
-        if (status == BluetoothConnectionStatus::Disconnected) {
-            connectedDevice.reset();
-            rxCharacteristic.reset();
-            txCharacteristic.reset();
-            uartServiceGuid.reset();
-            rxUuid.reset();
-            txUuid.reset();
+    for (const auto& batch : batches) {
+        jsize length = (jsize)(batch.frames * batch.fieldCount);
+        jarray columns = nullptr;
 
-            std::wcout << L"Device disconnected. Checking last GATT error..." << std::endl;
-            // auto error = sender.DeviceInformation().Pairing().ProtectionLevel();  // Example for pairing error
-            // std::wcout << L"Last known error: " << static_cast<int>(error) << std::endl;
+        if (!batch.shorts.empty() && shortMethod) {
+            jshortArray values = env->NewShortArray(length);
+            if (values) {
+                env->SetShortArrayRegion(values, 0, length, reinterpret_cast<const jshort*>(batch.shorts.data()));
+                env->CallVoidMethod(javaObject, shortMethod, (jint)batch.subscription, values, (jint)batch.frames, (jint)batch.fieldCount);
+            }
+            columns = values;
+        }
+        else if (!batch.floats.empty() && floatMethod) {
+            jfloatArray values = env->NewFloatArray(length);
+            if (values) {
+                env->SetFloatArrayRegion(values, 0, length, batch.floats.data());
+                env->CallVoidMethod(javaObject, floatMethod, (jint)batch.subscription, values, (jint)batch.frames, (jint)batch.fieldCount);
+            }
+            columns = values;
         }
 
-        // Check connection status and print appropriate message
-        std::wcout << L"Connection Status Changed: " << (status == BluetoothConnectionStatus::Connected ? L"Connected" : L"Disconnected") << std::endl;
-
-        // Call Java `onDeviceDisconnected`
-        if (status == BluetoothConnectionStatus::Connected) {
-            CallJavaMethod(env, javaObject, "onDeviceConnected", "(Ljava/lang/String;)V", "Device Connected");
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
         }
-        else {
-            CallJavaMethod(env, javaObject, "onDeviceDisconnected", "(Ljava/lang/String;)V", "Device Disconnected");
+        if (columns) {
+            env->DeleteLocalRef(columns);
         }
+    }
+}
 
-        // Get JavaVM from env
-        JavaVM* jvm;
-        env->GetJavaVM(&jvm);
+// Point in time the remaining steps of a connect must finish by, unset lets every step take as long as it needs
+using ConnectDeadline = std::optional<std::chrono::steady_clock::time_point>;
 
-        // Detach from the thread after use
-        jvm->DetachCurrentThread();
+// Function to wait for a connect step within the deadline, the operation is cancelled and nothing returned when it runs out
+template <typename T>
+std::optional<T> AwaitConnectStep(winrt::Windows::Foundation::IAsyncOperation<T> const& operation, const ConnectDeadline& deadline) {
+    if (!deadline) {
+        return operation.get();
     }
-    catch (const winrt::hresult_error& e) {
-        std::cerr << "Exception while handling connection status: " << e.message().c_str() << std::endl;
+
+    auto remaining = (std::max)(*deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+    if (operation.wait_for(std::chrono::duration_cast<winrt::Windows::Foundation::TimeSpan>(remaining)) == winrt::Windows::Foundation::AsyncStatus::Started) {
+        operation.Cancel();
+        std::cerr << "Connect step missed the deadline." << std::endl;
+        return std::nullopt;
+    }
+    return operation.GetResults(); // Rethrows the error of a failed operation
+}
+
+// Function to drop the UART characteristics, the device stays connected
+// The notification handler is revoked first so it cannot outlive the characteristic it was registered on
+void ReleaseUARTCharacteristics() {
+    std::shared_ptr<GattCharacteristic> rx;
+    std::shared_ptr<GattCharacteristic> tx;
+    winrt::event_token token{};
+    {
+        std::lock_guard<std::mutex> lock(connectionMutex);
+        rx = std::move(rxCharacteristic);
+        tx = std::move(txCharacteristic);
+        token = std::exchange(valueChangedToken, {});
+    }
+
+    if (tx && token) {
+        try {
+            tx->ValueChanged(token);
+        }
+        catch (const winrt::hresult_error& e) {
+            std::cerr << "Unable to revoke the notification handler: " << winrt::to_string(e.message()) << std::endl;
+        }
     }
 }
 
 // Function to initialize UART characteristics (RX, TX, etc.)
-jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::guid uartServiceGuid, winrt::guid rxId, winrt::guid txId) {
+jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::guid uartServiceGuid, winrt::guid rxId, winrt::guid txId, ConnectDeadline deadline = std::nullopt) {
     try {
-        // Check if UART service and characteristics are already initialized
-        if (connectedDevice == nullptr && rxCharacteristic == nullptr && txCharacteristic == nullptr) {
-            std::wcout << "UART characteristics already initialized, reusing existing values." << std::endl;
-            return JNI_TRUE;
+        // Work on a snapshot, a link loss may tear the connection down while the services resolve
+        auto device = GetConnectedDevice();
+        if (!device) {
+            std::cerr << "No device connected!" << std::endl;
+            return JNI_FALSE;
         }
 
+        // A repeated initialization must not leave the earlier handler registered, it would deliver twice
+        ReleaseUARTCharacteristics();
+
         // Store global variable
         txUuid = txId;
         rxUuid = rxId;
 
         // Connect to the GATT service asynchronously
-        auto asyncOperation = connectedDevice->GetGattServicesForUuidAsync(uartServiceGuid);
-        auto gattServiceResult = asyncOperation.get();  // Use .get() to block and get the result.
-        auto services = gattServiceResult.Services();  // Save the services to a variable for readability.
+        auto gattServiceResult = AwaitConnectStep(device->GetGattServicesForUuidAsync(uartServiceGuid), deadline);
+        if (!gattServiceResult) {
+            return JNI_FALSE;
+        }
+        auto services = gattServiceResult->Services();  // Save the services to a variable for readability.
 
         if (services.Size() == 0) {
             std::cerr << "UART service not found!" << std::endl;
@@ -286,12 +2215,15 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
         // Get the characteristics for RX and TX UUIDs
         auto rxCharOperation = services.GetAt(0).GetCharacteristicsForUuidAsync(rxId);
         auto txCharOperation = services.GetAt(0).GetCharacteristicsForUuidAsync(txId);
-        auto rxCharResult = rxCharOperation.get();
-        auto txCharResult = txCharOperation.get();
+        auto rxCharResult = AwaitConnectStep(rxCharOperation, deadline);
+        auto txCharResult = AwaitConnectStep(txCharOperation, deadline);
+        if (!rxCharResult || !txCharResult) {
+            return JNI_FALSE;
+        }
 
         // Block and get RX characteristics & TX characteristics
-        auto txChar = txCharResult.Characteristics();
-        auto rxChar = rxCharResult.Characteristics();
+        auto txChar = txCharResult->Characteristics();
+        auto rxChar = rxCharResult->Characteristics();
 
         // Print all 
         for (uint32_t i = 0; i < txChar.Size(); ++i) {
@@ -313,8 +2245,35 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
         }
 
         // Initialize the UART (enable notifications, etc.)
-        rxCharacteristic = std::make_shared<GattCharacteristic>(rxChar.GetAt(0)); // This is where you'll write data to the micro:bit (RX)
-        txCharacteristic = std::make_shared<GattCharacteristic>(txChar.GetAt(0)); // This is where you'll read data from the micro:bit (TX)
+        auto rx = std::make_shared<GattCharacteristic>(rxChar.GetAt(0)); // This is where you'll write data to the micro:bit (RX)
+        auto tx = std::make_shared<GattCharacteristic>(txChar.GetAt(0)); // This is where you'll read data from the micro:bit (TX)
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            if (connectedDevice != device) {
+                std::cerr << "Device disconnected while initializing UART characteristics!" << std::endl;
+                return JNI_FALSE;
+            }
+            rxCharacteristic = rx;
+            txCharacteristic = tx;
+        }
+
+        // Bulk transfers can keep a window of writes in flight when RX accepts writes without response
+        rxWithoutResponse.store((rx->CharacteristicProperties() & GattCharacteristicProperties::WriteWithoutResponse) != GattCharacteristicProperties::None);
+
+        // Every connection starts tuning from the safe settings
+        ResetWriterTuning();
+
+        // Partial frames of an earlier subscription would misalign the decoders and the channel parser
+        {
+            std::lock_guard<std::mutex> lock(decoderMutex);
+            for (auto& decoder : frameDecoders) {
+                decoder.second.pending.clear();
+            }
+        }
+        ResetChannelInbound();
+
+        // Batched notifications of this subscription carry a new session id
+        notificationSession++;
 
 
         if (globalObj == nullptr) {
@@ -326,7 +2285,15 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
         env->GetJavaVM(&jvm);
 
         // Enable notifications for the TX characteristic (Micro:bit sending data)
-        txCharacteristic->ValueChanged([env, jvm](GattCharacteristic sender, GattValueChangedEventArgs args) {
+        auto token = tx->ValueChanged([env, jvm](GattCharacteristic sender, GattValueChangedEventArgs args) {
+            HandlerGuard guard;
+            if (!guard) {
+                return; // Torn down while this notification was dispatched
+            }
+
+            uint64_t traceId = TraceSample();
+            TraceScope handlerScope("notify.ValueChanged", traceId);
+
             try {
                 // Log that the callback was triggered
                 std::wcout << L"Indication received from TX characteristic!" << std::endl;
@@ -341,7 +2308,94 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
                 }
 
                 std::vector<uint8_t> dataBytes(length);
-                DataReader::FromBuffer(dataBuffer).ReadBytes(dataBytes);
+                {
+                    TraceScope scope("winrt.ReadBytes", traceId);
+                    DataReader::FromBuffer(dataBuffer).ReadBytes(dataBytes);
+                }
+
+                // With channels open the stream carries frames, demultiplex them before touching the JVM
+                if (openChannelCount.load() > 0) {
+                    auto frames = DemultiplexChannels(dataBytes);
+
+                    // Frames of channels with a schema are decoded natively instead of delivered as bytes
+                    std::vector<DecodedBatch> batches;
+                    if (decoderCount.load() > 0) {
+                        TraceScope scope("native.decode", traceId);
+                        frames.erase(std::remove_if(frames.begin(), frames.end(), [&batches](const auto& frame) {
+                            return FeedFrameDecoder(frame.first, frame.second, batches);
+                        }), frames.end());
+                    }
+
+                    // With batching on, frames are packed for `onNotificationBatch` instead of one upcall each
+                    if (batchingEnabled.load(std::memory_order_relaxed)) {
+                        TraceScope scope("native.batch", traceId);
+                        frames.erase(std::remove_if(frames.begin(), frames.end(), [](const auto& frame) {
+                            return BatchNotification((int16_t)frame.first, frame.second.data(), frame.second.size());
+                        }), frames.end());
+                    }
+
+                    if (frames.empty() && batches.empty()) {
+                        return;
+                    }
+
+                    JNIEnv* attachedEnv = nullptr;
+                    int64_t attachStart = traceId ? TraceNow() : 0;
+                    if (jvm->AttachCurrentThread((void**)&attachedEnv, nullptr) != JNI_OK) {
+                        std::cerr << "Failed to attach current thread to JVM" << std::endl;
+                        return;
+                    }
+                    TraceSpan("jni.AttachCurrentThread", traceId, attachStart, traceId ? TraceNow() : 0);
+
+                    // Call Java `onSensorBatch` per decoded batch and `onChannelData` for every other frame
+                    if (!batches.empty()) {
+                        TraceScope scope("jni.onSensorBatch", traceId);
+                        CallJavaSensorBatches(attachedEnv, globalObj, batches);
+                    }
+                    if (!frames.empty()) {
+                        TraceScope scope("jni.onChannelData", traceId);
+                        CallJavaChannelData(attachedEnv, globalObj, frames);
+                    }
+
+                    jvm->DetachCurrentThread();
+                    return;
+                }
+
+                // A schema on the raw stream replaces the string callback with decoded batches
+                std::vector<DecodedBatch> batches;
+                bool decoded = false;
+                if (decoderCount.load() > 0) {
+                    TraceScope scope("native.decode", traceId);
+                    decoded = FeedFrameDecoder(RAW_SUBSCRIPTION, dataBytes, batches);
+                }
+
+                if (decoded) {
+                    if (batches.empty()) {
+                        return;
+                    }
+
+                    JNIEnv* attachedEnv = nullptr;
+                    if (jvm->AttachCurrentThread((void**)&attachedEnv, nullptr) != JNI_OK) {
+                        std::cerr << "Failed to attach current thread to JVM" << std::endl;
+                        return;
+                    }
+
+                    // Call Java `onSensorBatch` once per batch
+                    {
+                        TraceScope scope("jni.onSensorBatch", traceId);
+                        CallJavaSensorBatches(attachedEnv, globalObj, batches);
+                    }
+
+                    jvm->DetachCurrentThread();
+                    return;
+                }
+
+                // With batching on, the notification is packed for `onNotificationBatch` instead of its own upcall
+                {
+                    TraceScope scope("native.batch", traceId);
+                    if (BatchNotification(BATCH_RAW_CHANNEL, dataBytes.data(), dataBytes.size())) {
+                        return;
+                    }
+                }
 
                 // Convert bytes to a readable format (e.g., UTF-8 string)
                 std::string receivedData(dataBytes.begin(), dataBytes.end());
@@ -350,14 +2404,19 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
 
                 // Attach the current thread to the JVM if needed
                 JNIEnv* attachedEnv = nullptr;
+                int64_t attachStart = traceId ? TraceNow() : 0;
                 // Correct the type here by passing (void**)&attachedEnv
                 if (jvm->AttachCurrentThread((void**)&attachedEnv, nullptr) != JNI_OK) {
                     std::cerr << "Failed to attach current thread to JVM" << std::endl;
                     return;
                 }
+                TraceSpan("jni.AttachCurrentThread", traceId, attachStart, traceId ? TraceNow() : 0);
 
                 // Call Java `onDeviceNotificationReceived`
-                CallJavaMethod(attachedEnv, globalObj, "onDeviceNotificationReceived", "(Ljava/lang/String;)V", receivedData.c_str());
+                {
+                    TraceScope scope("jni.onDeviceNotificationReceived", traceId);
+                    CallJavaMethod(attachedEnv, globalObj, "onDeviceNotificationReceived", "(Ljava/lang/String;)V", receivedData.c_str());
+                }
 
                 // Detach from the thread after use
                 jvm->DetachCurrentThread();
@@ -367,46 +2426,307 @@ jboolean InitializeUARTCharacteristics(JNIEnv* env, jobject javaObject, winrt::g
             }
             });
 
+        // Teardown may have taken the characteristic meanwhile, then nothing else would revoke the handler
+        bool current;
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            current = txCharacteristic == tx;
+            if (current) {
+                valueChangedToken = token;
+            }
+        }
+
+        if (!current) {
+            tx->ValueChanged(token);
+            std::cerr << "Device disconnected while initializing UART characteristics!" << std::endl;
+            return JNI_FALSE;
+        }
+
         // Check if support notification 
-        auto properties = txCharacteristic->CharacteristicProperties();
+        auto properties = tx->CharacteristicProperties();
         if ((properties & GattCharacteristicProperties::Indicate) == GattCharacteristicProperties::None) {
             std::cerr << "TX characteristic does not support notifications!" << std::endl;
+            ReleaseUARTCharacteristics();
             return JNI_FALSE;
         }
 
         // Enable notifications on the TX characteristic
         GattClientCharacteristicConfigurationDescriptorValue config = GattClientCharacteristicConfigurationDescriptorValue::Indicate;
-        auto result = txCharacteristic->WriteClientCharacteristicConfigurationDescriptorAsync(config).get();
+        auto result = AwaitConnectStep(tx->WriteClientCharacteristicConfigurationDescriptorAsync(config), deadline);
 
-        if (SUCCEEDED(result)) {
+        if (result && *result == GattCommunicationStatus::Success) {
             std::cout << "Notifications successfully enabled for TX characteristic!" << std::endl;
         }
         else {
             std::cerr << "Failed to enable notifications for TX characteristic!" << std::endl;
-            txCharacteristic.reset();
-            rxCharacteristic.reset();
+            ReleaseUARTCharacteristics();
             return JNI_FALSE;
         }
 
+        // Size outbound fragments to the negotiated MTU
+        TrackMaxPduSize();
+
+        // Have the writer waiting before the first message, teardown of an earlier connection stopped it
+        StartOutboundWriter();
+
         std::cout << "UART characteristics initialized successfully!" << std::endl;
         return JNI_TRUE;
     }
     catch (const winrt::hresult_error& e) {
         std::cerr << "Exception initializing UART characteristics: " << e.message().c_str() << std::endl;
-        txCharacteristic.reset();
-        rxCharacteristic.reset();
+        ReleaseUARTCharacteristics();
         return JNI_FALSE;
     }
 }
 
-// Initialize the class obj
-extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_initialize(JNIEnv* env, jobject obj) {
+// Struct to hold a bulk transfer, it is kept after a failure so it can be resumed
+struct BulkTransfer {
+    std::vector<uint8_t> data;
+    size_t checkpoint = 0; // Bytes confirmed by the last acknowledged write
+    size_t checkpointInterval = 0;
+};
 
-    // Initialize the WinRT apartment for BLE operations
-    init_apartment();
+// Bulk transfer state, survives a disconnect so the transfer can resume after reconnecting
+std::mutex bulkMutex;
+std::optional<BulkTransfer> bulkTransfer = std::nullopt;
+std::atomic<bool> isTransferring{ false };
+
+// Default bytes between two checkpoints and minimum time between two progress callbacks
+constexpr size_t DEFAULT_CHECKPOINT_INTERVAL = 4096;
+constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+// Every segment starts with a marker, its offset in the transfer and its length (both uint32 little-endian),
+// a resumed transfer replays from the last checkpoint so the board drops bytes below the offset it already has
+constexpr uint8_t BULK_SEGMENT_MARKER = 0xB7;
+constexpr size_t BULK_SEGMENT_HEADER_SIZE = 9;
+
+// Function to build a segment with its header
+std::vector<uint8_t> BuildBulkSegment(const std::vector<uint8_t>& data, size_t offset, size_t length) {
+    std::vector<uint8_t> segment;
+    segment.reserve(BULK_SEGMENT_HEADER_SIZE + length);
+    segment.push_back(BULK_SEGMENT_MARKER);
+    for (int shift = 0; shift < 32; shift += 8) {
+        segment.push_back((uint8_t)(offset >> shift));
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+        segment.push_back((uint8_t)(length >> shift));
+    }
+    segment.insert(segment.end(), data.begin() + offset, data.begin() + offset + length);
+    return segment;
+}
+
+// Function to stream the stored bulk transfer from its last checkpoint, isTransferring must already be set
+jboolean RunBulkTransfer(JNIEnv* env, jobject javaObject) {
+    // Progress callback is optional on the Java side
+    jmethodID progressMethod = GetCallback(env, javaObject, "onTransferProgress", "(JJ)V");
+
+    bool success = true;
+    auto lastProgress = std::chrono::steady_clock::time_point{};
+
+    while (true) {
+        std::vector<uint8_t> segment;
+        size_t offset = 0;
+        size_t length = 0;
+        size_t total = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(bulkMutex);
+            if (!bulkTransfer) {
+                success = false;
+                break;
+            }
+
+            total = bulkTransfer->data.size();
+            offset = bulkTransfer->checkpoint;
+            if (offset >= total) {
+                break;
+            }
+
+            length = (std::min)(bulkTransfer->checkpointInterval, total - offset);
+            segment = BuildBulkSegment(bulkTransfer->data, offset, length);
+        }
+
+        // Each segment is a windowed message, its acknowledged last fragment is the checkpoint
+        auto result = std::make_shared<std::promise<bool>>();
+        auto written = result->get_future();
+
+        if (!EnqueueOutbound(std::move(segment), PRIORITY_BULK, std::nullopt, [result](bool ok) { result->set_value(ok); }, true) || !written.get()) {
+            std::cerr << "Bulk transfer interrupted at " << offset << " of " << total << " bytes." << std::endl;
+            success = false;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(bulkMutex);
+            if (bulkTransfer) {
+                bulkTransfer->checkpoint = offset + length;
+            }
+        }
+
+        // Throttle progress callbacks, the final one is always delivered
+        auto now = std::chrono::steady_clock::now();
+        bool done = offset + length >= total;
+        if (progressMethod && (done || now - lastProgress >= PROGRESS_INTERVAL)) {
+            env->CallVoidMethod(javaObject, progressMethod, (jlong)(offset + length), (jlong)total);
+            if (env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+            }
+            lastProgress = now;
+        }
+    }
+
+    if (success) {
+        std::lock_guard<std::mutex> lock(bulkMutex);
+        bulkTransfer.reset();
+        std::cout << "Bulk transfer completed." << std::endl;
+    }
+
+    isTransferring.store(false);
+    return success ? JNI_TRUE : JNI_FALSE;
+}
+
+// Function to start a new bulk transfer, replacing any transfer that was left unfinished
+jboolean StartBulkTransfer(JNIEnv* env, jobject javaObject, std::vector<uint8_t>&& data, jint checkpointBytes) {
+    if (!GetConnectedDevice() || !GetRxCharacteristic()) {
+        std::cerr << "No device connected!" << std::endl;
+        return JNI_FALSE;
+    }
+
+    if (data.empty()) {
+        std::cerr << "Error: nothing to transfer." << std::endl;
+        return JNI_FALSE;
+    }
+
+    if (data.size() > UINT32_MAX) {
+        std::cerr << "Error: transfer exceeds the 4 GiB segment offset range." << std::endl;
+        return JNI_FALSE;
+    }
+
+    if (isTransferring.exchange(true)) {
+        std::cerr << "Bulk transfer already in progress." << std::endl;
+        return JNI_FALSE;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(bulkMutex);
+        bulkTransfer = BulkTransfer{ std::move(data), 0, checkpointBytes > 0 ? (size_t)checkpointBytes : DEFAULT_CHECKPOINT_INTERVAL };
+    }
+
+    return RunBulkTransfer(env, javaObject);
+}
+
+// Longest time `initialize` waits for the runtime warm-up
+constexpr auto DEFAULT_READY_TIMEOUT = std::chrono::milliseconds(5000);
+
+// Function to resolve the Java classes and callbacks once, anything missing is looked up on use instead
+void CacheJavaClasses(JNIEnv* env) {
+    auto globalClass = [env](const char* name) -> jclass {
+        jclass local = env->FindClass(name);
+        if (!local) {
+            env->ExceptionClear();
+            std::cerr << "Failed to find Java class: " << name << std::endl;
+            return nullptr;
+        }
+
+        jclass global = (jclass)env->NewGlobalRef(local);
+        env->DeleteLocalRef(local);
+        return global;
+    };
+
+    auto method = [env](jclass javaClass, const char* name, const char* signature) -> jmethodID {
+        if (!javaClass) {
+            return nullptr;
+        }
+
+        jmethodID methodId = env->GetMethodID(javaClass, name, signature);
+        if (!methodId) {
+            env->ExceptionClear(); // Optional callbacks may not exist
+        }
+        return methodId;
+    };
+
+    runtime.bleClass = globalClass("com/bitbybit/services/bluetooth/BluetoothBLE");
+    for (auto& entry : runtime.callbacks) {
+        entry.id = method(runtime.bleClass, entry.name, entry.signature);
+    }
+
+    runtime.deviceClass = globalClass("com/bitbybit/services/bluetooth/BLEDevice");
+    runtime.deviceConstructor = method(runtime.deviceClass, "<init>", "(Ljava/lang/String;Ljava/lang/String;)V");
+
+    runtime.arrayListClass = globalClass("java/util/ArrayList");
+    runtime.arrayListConstructor = method(runtime.arrayListClass, "<init>", "()V");
+    runtime.arrayListAdd = method(runtime.arrayListClass, "add", "(Ljava/lang/Object;)Z");
+}
+
+// Function to release the cached classes when the library is unloaded
+void ReleaseJavaClasses(JNIEnv* env) {
+    for (jclass* javaClass : { &runtime.bleClass, &runtime.deviceClass, &runtime.arrayListClass }) {
+        if (*javaClass != nullptr) {
+            env->DeleteGlobalRef(*javaClass);
+            *javaClass = nullptr;
+        }
+    }
+
+    for (auto& entry : runtime.callbacks) {
+        entry.id = nullptr;
+    }
+    runtime.deviceConstructor = nullptr;
+    runtime.arrayListConstructor = nullptr;
+    runtime.arrayListAdd = nullptr;
+}
+
+// Thread function to load the Bluetooth stack ahead of the first call and signal readiness
+void WarmUpRuntime() {
+    bool ready = true;
+
+    try {
+        init_apartment();
+
+        // Activating the factories loads the Bluetooth WinRT components, the first scan then starts right away
+        BluetoothLEAdvertisementWatcher watcher;
+        auto adapter = BluetoothAdapter::GetDefaultAsync().get();
+        if (adapter == nullptr) {
+            std::cerr << "No Bluetooth adapter found." << std::endl;
+            ready = false;
+        }
+
+        // The first write should not pay for the writer thread, an unload that gave up waiting already stopped it
+        if (!runtime.unloading.load()) {
+            StartOutboundWriter();
+        }
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception warming up the runtime: " << winrt::to_string(e.message()) << std::endl;
+        ready = false;
+    }
+
+    metrics[METRIC_COLD_START_MICROS].store(TraceNow() - runtime.loadedAt);
+    runtime.readyPromise.set_value(ready);
+}
+
+// Function to wait for the runtime warm-up, returns its result or false on timeout
+bool AwaitRuntime(std::chrono::milliseconds timeout) {
+    if (!runtime.ready.valid()) {
+        return false; // Loaded without JNI_OnLoad
+    }
+
+    return runtime.ready.wait_for(timeout) == std::future_status::ready && runtime.ready.get();
+}
+
+// Initialize the class obj
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_initialize(JNIEnv* env, jobject obj) {
 
     // UTF8 for debugger
     // init();
+
+    // The apartment and caches are set up in JNI_OnLoad, wait for the warm-up to finish
+    return AwaitRuntime(DEFAULT_READY_TIMEOUT) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Function to wait for the native runtime, returns false if it did not become ready within the timeout
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_awaitReady(JNIEnv* env, jobject obj, jint timeoutMs) {
+    return AwaitRuntime(std::chrono::milliseconds((std::max)(0, (int)timeoutMs))) ? JNI_TRUE : JNI_FALSE;
 }
 
 // JNI function to initialize UART characteristics
@@ -420,14 +2740,11 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
             return JNI_FALSE; // Invalid input parameters
         }
 
-        if (!connectedDevice) {
+        if (!GetConnectedDevice()) {
             std::wcout << "No device connected to " << std::endl;
             return JNI_FALSE;
         }
 
-        // Initialize the WinRT apartment for BLE operations
-        init_apartment();
-
         const char* uartServiceUuidChar = env->GetStringUTFChars(uartServiceUuidStr, nullptr);
         std::wstring uartServiceUuid(uartServiceUuidChar, uartServiceUuidChar + strlen(uartServiceUuidChar));
         env->ReleaseStringUTFChars(uartServiceUuidStr, uartServiceUuidChar);
@@ -446,7 +2763,7 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
         winrt::guid txGuid(txUuid);
 
         // Check if a device is already connected
-        if (connectedDevice) {
+        if (GetConnectedDevice()) {
             std::cout << "Initializing UART Service" << std::endl;
 
             // Initialize UART Characteristics on the connected device
@@ -478,9 +2795,8 @@ extern "C" __declspec(dllexport) jobject JNICALL Java_com_bitbybit_services_blue
         }
 
         // Check if a device is connect
-        if (connectedDevice) {
-            connectedDevice->Close();
-            connectedDevice.reset();
+        if (GetConnectedDevice()) {
+            TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
             std::cout << "Device disconnected cause of searching." << std::endl;
         }
 
@@ -523,6 +2839,7 @@ extern "C" __declspec(dllexport) jobject JNICALL Java_com_bitbybit_services_blue
 
         // Start scanning for BLE devices
         watcher.Start();
+        RecordFirstScan();
 
         // Searching bt
         std::wcout << "Searching BLE devcies..." << std::endl;
@@ -548,26 +2865,26 @@ extern "C" __declspec(dllexport) jobject JNICALL Java_com_bitbybit_services_blue
             return nullptr;  // Return null if no devices are found
         }
         else {
-            // Get the BLEDevice class
-            jclass deviceClass = env->FindClass("com/bitbybit/services/bluetooth/BLEDevice");
+            // Get the BLEDevice class, cached by the runtime
+            jclass deviceClass = runtime.deviceClass ? runtime.deviceClass : env->FindClass("com/bitbybit/services/bluetooth/BLEDevice");
             if (!deviceClass) {
                 std::cerr << "BLEDevice class not found!" << std::endl;
                 return nullptr;
             }
 
             // Get BLEDevice Constructor
-            jmethodID deviceConstructor = env->GetMethodID(deviceClass, "<init>", "(Ljava/lang/String;Ljava/lang/String;)V");
+            jmethodID deviceConstructor = runtime.deviceConstructor ? runtime.deviceConstructor : env->GetMethodID(deviceClass, "<init>", "(Ljava/lang/String;Ljava/lang/String;)V");
             if (!deviceConstructor) {
                 std::cerr << "BLEDevice constructor not found!" << std::endl;
                 return nullptr;
             }
 
             // Create a Java ArrayList to hold the devices
-            jclass arrayListClass = env->FindClass("java/util/ArrayList");
-            jmethodID arrayListConstructor = env->GetMethodID(arrayListClass, "<init>", "()V");
+            jclass arrayListClass = runtime.arrayListClass ? runtime.arrayListClass : env->FindClass("java/util/ArrayList");
+            jmethodID arrayListConstructor = runtime.arrayListConstructor ? runtime.arrayListConstructor : env->GetMethodID(arrayListClass, "<init>", "()V");
             jobject arrayList = env->NewObject(arrayListClass, arrayListConstructor);
 
-            jmethodID addMethod = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
+            jmethodID addMethod = runtime.arrayListAdd ? runtime.arrayListAdd : env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
 
 
             // Update the loop where devices are added to the ArrayList
@@ -592,38 +2909,216 @@ extern "C" __declspec(dllexport) jobject JNICALL Java_com_bitbybit_services_blue
                 }
 
 
-                // Create a new Device object
-                jobject deviceObject = env->NewObject(deviceClass, deviceConstructor, deviceNameStr, deviceAddressStr);
+                // Create a new Device object
+                jobject deviceObject = env->NewObject(deviceClass, deviceConstructor, deviceNameStr, deviceAddressStr);
+
+                // Add the Device object to the ArrayList
+                env->CallBooleanMethod(arrayList, addMethod, deviceObject);
+
+                // Clean up local references
+                env->DeleteLocalRef(deviceNameStr);
+                env->DeleteLocalRef(deviceAddressStr);
+                env->DeleteLocalRef(deviceObject);
+            }
+
+            // Return the ArrayList to Java
+            return arrayList;
+        }
+
+        return nullptr;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception occurred: " << e.what() << std::endl;
+
+        // Reset is searching
+        isSearching.store(false);
+        return nullptr;
+    }
+    catch (...) {
+        std::cerr << "Unknown error occurred." << std::endl;
+
+        // Reset is searching
+        isSearching.store(false);
+        return nullptr;
+    }
+}
+
+// Function to open a device by address and follow its connection status, full service discovery is optional
+jboolean ConnectToAddress(JNIEnv* env, jobject obj, uint64_t deviceAddress, bool discoverServices, ConnectDeadline deadline = std::nullopt) {
+    // Check if the device is already connected and tear it down if needed, handlers and characteristics go with it
+    if (GetConnectedDevice() || GetTxCharacteristic()) {
+        std::wcout << L"Disconnecting from the current device before trying to connect to a new one." << std::endl;
+        TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+    }
+
+    // Retrieve the BLE device using its Bluetooth address
+    auto lookup = AwaitConnectStep(BluetoothLEDevice::FromBluetoothAddressAsync(deviceAddress), deadline);
+    auto bleDevice = lookup ? *lookup : nullptr; // A lookup that missed the deadline counts as not found
+    
+    // Print the device connection status
+    // std::wcout << "Device status:" << static_cast<int>(bleDevice.ConnectionStatus()) << std::endl;
+
+    // Check if the device is found
+    if (bleDevice != nullptr) {
+        // Set Connected device
+        auto device = std::make_shared<BluetoothLEDevice>(bleDevice); // Use shared_ptr to avoid copying
+
+        if (globalObj == nullptr) {
+            saveGlobalReference(env, obj);
+        }
+
+        // Get JavaVM from env
+        JavaVM* jvm;
+        env->GetJavaVM(&jvm);
+      
+        // Subscribe to connection status change
+        auto token = device->ConnectionStatusChanged([env, jvm](auto&& sender, auto&& args) {
+            HandlerGuard guard;
+            if (!guard) {
+                return; // Torn down while this event was dispatched
+            }
+
+            // Attach the current thread to the JVM if needed
+            JNIEnv* attachedEnv = nullptr;
+            // Correct the type here by passing (void**)&attachedEnv
+            if (jvm->AttachCurrentThread((void**)&attachedEnv, nullptr) != JNI_OK) {
+                std::cerr << "Failed to attach current thread to JVM" << std::endl;
+                return;
+            }
+
+            // Call the event handler safely
+            OnConnectionStatusChanged(attachedEnv, globalObj, sender, args);
+
+            // Detach from the thread after use
+            jvm->DetachCurrentThread();
+        });
+
+        // Published with its handler so teardown always finds the token of the device it closes
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            connectedDevice = device;
+            connectionStatusChangedToken = token;
+        }
+
+        // Check connection status
+        if (device->ConnectionStatus() == BluetoothConnectionStatus::Connected) {
+            std::wcout << L"Device is already connected." << std::endl;
+            return JNI_TRUE;
+        }
+        else if (!discoverServices) {
+            // Resolving the UART service afterwards connects on demand, a full discovery is not needed
+            return JNI_TRUE;
+        }
+        else {
+            std::wcout << L"Attempting to connect..." << std::endl;
+
+            // Attempt to discover GATT services
+            auto discovery = AwaitConnectStep(device->GetGattServicesAsync(), deadline); // Wait for GATT services discovery
+            if (!discovery) {
+                TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+                return JNI_FALSE;
+            }
+            auto gattServices = *discovery;
+
+            // Check if the device is connected or reachable
+            if (bleDevice.ConnectionStatus() == BluetoothConnectionStatus::Disconnected) {
+                std::cerr << "Device is off or unreachable!" << std::endl;
+                TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+                return JNI_FALSE; // Handle device being off or unreachable
+            }
+
+            // Check if device is already connected
+            if (gattServices.Status() == GattCommunicationStatus::Success) {
+                auto services = gattServices.Services();
+                std::wcout << L"Device connected successfully. Services available: " << services.Size() << std::endl;
+                return JNI_TRUE;
+            }
+            else {
+                std::wcerr << L"Failed to discover GATT services. Status: " << static_cast<int>(gattServices.Status()) << std::endl;
+                TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+                return JNI_FALSE;
+            }
+        }
+    }
+    else {
+        std::cerr << "Failed to connect to device!" << std::endl;
+        return JNI_FALSE;
+    }
+}
+
+// Struct to describe the device a targeted scan is looking for, unset fields match anything
+struct ScanTarget {
+    std::optional<uint64_t> address;
+    std::wstring namePattern;
+    std::optional<winrt::guid> serviceUuid;
+};
+
+// Function to convert an optional Java string to std::wstring
+std::wstring JStringToWString(JNIEnv* env, jstring str) {
+    if (str == nullptr) {
+        return {};
+    }
+
+    const jchar* rawString = env->GetStringChars(str, nullptr);
+    if (rawString == nullptr) {
+        return {};
+    }
+
+    std::wstring result(rawString, rawString + env->GetStringLength(str));
+    env->ReleaseStringChars(str, rawString);
+    return result;
+}
+
+// Function to scan until the first advertisement matching the target, returns its address
+std::optional<uint64_t> ScanForTarget(const ScanTarget& target, std::chrono::milliseconds timeout) {
+    BluetoothLEAdvertisementWatcher watcher;
+
+    // Address matches only need the advertisement itself, names and services may live in the scan response
+    bool passive = target.namePattern.empty() && !target.serviceUuid;
+    watcher.ScanningMode(passive ? BluetoothLEScanningMode::Passive : BluetoothLEScanningMode::Active);
+
+    // Let the stack filter on the service when one is given
+    if (target.serviceUuid) {
+        watcher.AdvertisementFilter().Advertisement().ServiceUuids().Append(*target.serviceUuid);
+    }
+
+    // Shared with the handler, events may still arrive shortly after Stop
+    auto found = std::make_shared<std::promise<uint64_t>>();
+    auto matched = std::make_shared<std::atomic<bool>>(false);
+    auto result = found->get_future();
 
-                // Add the Device object to the ArrayList
-                env->CallBooleanMethod(arrayList, env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z"), deviceObject);
+    watcher.Received([target, found, matched](BluetoothLEAdvertisementWatcher const&, BluetoothLEAdvertisementReceivedEventArgs const& args) {
+        try {
+            uint64_t deviceAddress = args.BluetoothAddress();
+            if (target.address && *target.address != deviceAddress) {
+                return;
+            }
 
-                // Clean up local references
-                env->DeleteLocalRef(deviceNameStr);
-                env->DeleteLocalRef(deviceAddressStr);
-                env->DeleteLocalRef(deviceObject);
+            if (!target.namePattern.empty()) {
+                std::wstring deviceName = args.Advertisement().LocalName().c_str();
+                if (deviceName.find(target.namePattern) == std::wstring::npos) {
+                    return;
+                }
             }
 
-            // Return the ArrayList to Java
-            return arrayList;
+            if (!matched->exchange(true)) {
+                found->set_value(deviceAddress);
+            }
         }
+        catch (const winrt::hresult_error& e) {
+            std::cerr << "Exception while matching advertisement: " << winrt::to_string(e.message()) << std::endl;
+        }
+    });
 
-        return nullptr;
-    }
-    catch (const std::exception& e) {
-        std::cerr << "Exception occurred: " << e.what() << std::endl;
-
-        // Reset is searching
-        isSearching.store(false);
-        return nullptr;
-    }
-    catch (...) {
-        std::cerr << "Unknown error occurred." << std::endl;
+    watcher.Start();
+    RecordFirstScan();
+    auto status = result.wait_for(timeout);
+    watcher.Stop();
 
-        // Reset is searching
-        isSearching.store(false);
-        return nullptr;
+    if (status != std::future_status::ready) {
+        return std::nullopt;
     }
+    return result.get();
 }
 
 // Function to connect to the Bluetooth device by address
@@ -645,107 +3140,129 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
         std::wstring deviceAddressWString(rawString, rawString + env->GetStringLength(deviceAddressStr)); // Correctly construct wstring
         env->ReleaseStringChars(deviceAddressStr, rawString);
 
-        // Convert std::wstring to uint64_t for the Bluetooth address
-        uint64_t deviceAddress = std::stoull(deviceAddressWString, nullptr, 16); // Hexadecimal address
-
-        // Check if the device is already connected and reset if needed
-        if (connectedDevice != nullptr) {
-            std::wcout << L"Disconnecting from the current device before trying to connect to a new one." << std::endl;
-            connectedDevice->Close();  // Close any previous connection
-            connectedDevice.reset();   // Reset the connection state
+        // Convert std::wstring to uint64_t for the Bluetooth address, a malformed address leaves the current connection alone
+        uint64_t deviceAddress;
+        try {
+            deviceAddress = std::stoull(deviceAddressWString, nullptr, 16); // Hexadecimal address
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: Invalid device address: " << e.what() << std::endl;
+            return JNI_FALSE;
         }
 
-        // Retrieve the BLE device using its Bluetooth address
-        auto asyncOperation = BluetoothLEDevice::FromBluetoothAddressAsync(deviceAddress);
-        auto bleDevice = asyncOperation.get(); // Wait for the async operation to complete
-        
-        // Print the device connection status
-        // std::wcout << "Device status:" << static_cast<int>(bleDevice.ConnectionStatus()) << std::endl;
+        return ConnectToAddress(env, obj, deviceAddress, true);
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception while connecting to device: " << winrt::to_string(e.message()) << std::endl;
+        TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+        return JNI_FALSE;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception while connecting to device: " << e.what() << std::endl;
+        TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+        return JNI_FALSE;
+    }
+}
 
-        // Check if the device is found
-        if (bleDevice != nullptr) {
-            // Set Connected device
-            connectedDevice = std::make_shared<BluetoothLEDevice>(bleDevice); // Use shared_ptr to avoid copying
+// Function to scan for a target (address, name pattern or advertised service), connect and initialize UART in one call
+extern "C" __declspec(dllexport) jstring JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_connectToTarget(JNIEnv* env, jobject obj, jstring deviceAddressStr, jstring namePatternStr, jstring serviceUuidStr, jstring uartServiceUuidStr, jstring rxUuidStr, jstring txUuidStr, jint timeoutMs) {
+    // Set once the connection state is touched, only then a failure has anything to tear down
+    bool connecting = false;
 
-            if (globalObj == nullptr) {
-                saveGlobalReference(env, obj);
-            }
+    try {
+        if (uartServiceUuidStr == nullptr || rxUuidStr == nullptr || txUuidStr == nullptr) {
+            std::cerr << "Error: One or more UUID parameters are null." << std::endl;
+            return nullptr;
+        }
 
-            // Get JavaVM from env
-            JavaVM* jvm;
-            env->GetJavaVM(&jvm);
-          
-            // Subscribe to connection status change
-            connectedDevice->ConnectionStatusChanged([env, jvm](auto&& sender, auto&& args) {
-                // Attach the current thread to the JVM if needed
-                JNIEnv* attachedEnv = nullptr;
-                // Correct the type here by passing (void**)&attachedEnv
-                if (jvm->AttachCurrentThread((void**)&attachedEnv, nullptr) != JNI_OK) {
-                    std::cerr << "Failed to attach current thread to JVM" << std::endl;
-                    return;
-                }
+        // Parse every argument before the connection state is touched
+        ScanTarget target;
+        winrt::guid uartServiceGuid, rxGuid, txGuid;
+        try {
+            std::wstring deviceAddress = JStringToWString(env, deviceAddressStr);
+            if (!deviceAddress.empty()) {
+                target.address = std::stoull(deviceAddress, nullptr, 16);
+            }
+            target.namePattern = JStringToWString(env, namePatternStr);
+            std::wstring serviceUuid = JStringToWString(env, serviceUuidStr);
+            if (!serviceUuid.empty()) {
+                target.serviceUuid = winrt::guid(serviceUuid);
+            }
 
-                // Call the event handler safely
-                OnConnectionStatusChanged(attachedEnv, globalObj, sender, args);
+            uartServiceGuid = winrt::guid(JStringToWString(env, uartServiceUuidStr));
+            rxGuid = winrt::guid(JStringToWString(env, rxUuidStr));
+            txGuid = winrt::guid(JStringToWString(env, txUuidStr));
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: Invalid target address or UUID: " << e.what() << std::endl;
+            return nullptr;
+        }
 
-                // Detach from the thread after use
-                jvm->DetachCurrentThread();
-            });        
+        // Share the radio with searchBLEDevices
+        if (isSearching.exchange(true)) {
+            std::wcout << L"Search already in progress. Please wait." << std::endl;
+            return nullptr;
+        }
 
-            // Check connection status
-            if (connectedDevice->ConnectionStatus() == BluetoothConnectionStatus::Connected) {
-                std::wcout << L"Device is already connected." << std::endl;
-                return JNI_TRUE;
-            }
-            else {
-                std::wcout << L"Attempting to connect..." << std::endl;
+        // One budget covers the scan, the device lookup and the UART resolution
+        auto timeout = std::chrono::milliseconds(timeoutMs > 0 ? timeoutMs : 10000);
+        auto deadline = std::chrono::steady_clock::now() + timeout;
 
-                // Attempt to discover GATT services
-                auto gattServices = connectedDevice->GetGattServicesAsync().get(); // Wait for GATT services discovery
+        std::optional<uint64_t> found;
+        try {
+            found = ScanForTarget(target, timeout);
+        }
+        catch (...) {
+            isSearching.store(false);
+            throw;
+        }
+        isSearching.store(false);
 
-                // Check if the device is connected or reachable
-                if (bleDevice.ConnectionStatus() == BluetoothConnectionStatus::Disconnected) {
-                    std::cerr << "Device is off or unreachable!" << std::endl;
-                    return JNI_FALSE; // Handle device being off or unreachable
-                }
+        if (!found) {
+            std::cerr << "Target device not found before timeout." << std::endl;
+            return nullptr;
+        }
 
-                // Check if device is already connected
-                if (gattServices.Status() == GattCommunicationStatus::Success) {
-                    auto services = gattServices.Services();
-                    std::wcout << L"Device connected successfully. Services available: " << services.Size() << std::endl;
-                    return JNI_TRUE;
-                }
-                else {
-                    std::wcerr << L"Failed to discover GATT services. Status: " << static_cast<int>(gattServices.Status()) << std::endl;
-                    connectedDevice->Close();
-                    connectedDevice.reset();
-                    return JNI_FALSE;
-                }
-            }
+        // Connect right away, the UART lookup below establishes the link
+        connecting = true;
+        if (!ConnectToAddress(env, obj, *found, false, deadline) || !InitializeUARTCharacteristics(env, obj, uartServiceGuid, rxGuid, txGuid, deadline)) {
+            std::cerr << "Failed to connect to target device!" << std::endl;
+            TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT); // Do not leave a half connected device behind
+            return nullptr;
         }
-        else {
-            std::cerr << "Failed to connect to device!" << std::endl;
-            connectedDevice.reset();
-            return JNI_FALSE;
+
+        std::wstringstream addressStream;
+        addressStream << std::hex << *found;
+        std::wstring addressWString = addressStream.str();
+
+        return env->NewString((const jchar*)addressWString.c_str(), (jsize)addressWString.size());
+    }
+    catch (const winrt::hresult_error& e) {
+        std::cerr << "Exception while connecting to target: " << winrt::to_string(e.message()) << std::endl;
+        if (connecting) {
+            TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
         }
+        return nullptr;
     }
     catch (const std::exception& e) {
-        std::cerr << "Exception while connecting to device: " << e.what() << std::endl;
-        // This could involve resetting the event handler or other cleanup, depending on your API
-        connectedDevice.reset();
-        return JNI_FALSE;
+        std::cerr << "Exception while connecting to target: " << e.what() << std::endl;
+        if (connecting) {
+            TeardownConnection(DEFAULT_TEARDOWN_TIMEOUT);
+        }
+        return nullptr;
     }
 }
 
 // Function to disconnect the device
 extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_disconnectDevice(JNIEnv* env, jobject obj) {
     try {
-        if (connectedDevice != nullptr) {
-            connectedDevice->Close();
-            connectedDevice.reset();
- 
-            cleanup(env);
+        // Cleanup runs even after a link loss already tore the connection down, it still releases the global reference
+        bool connected = GetConnectedDevice() != nullptr;
 
+        // Teardown closes the device itself, after unsubscribing
+        cleanup(env);
+
+        if (connected) {
             std::cout << "Device disconnected successfully." << std::endl;
             return JNI_TRUE;
         }
@@ -762,16 +3279,21 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
 
 // Function to write data to the RX characteristic
 extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_writeToRX(JNIEnv* env, jobject obj, jstring dataStr) {
+    uint64_t traceId = TraceSample();
+    TraceScope callScope("jni.writeToRX", traceId);
+
     try {
-        if (!connectedDevice) {
+        if (!GetConnectedDevice()) {
             std::cerr << "No device connected!" << std::endl;
             return JNI_FALSE;
         }
-        else if (!rxCharacteristic) {
+        else if (!GetRxCharacteristic()) {
             std::cerr << "No rxCharacteristic connected!" << std::endl;
             return JNI_FALSE;
         }
 
+        int64_t conversionStart = traceId ? TraceNow() : 0;
+
         // Convert the input jstring to std::wstring
         const char* dataChar = env->GetStringUTFChars(dataStr, nullptr);
         if (!dataChar) {
@@ -784,22 +3306,24 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
         // Convert std::wstring to UTF-8 encoded std::vector<uint8_t>
         std::vector<uint8_t> messageBytes = WStringToUTF8Bytes(data);  // Convert to bytes
 
-        // Convert the data to bytes using DataWriter
-        DataWriter writer;
-        writer.WriteBytes(messageBytes);
-        IBuffer buffer = writer.DetachBuffer();
+        TraceSpan("jni.GetStringUTFChars", traceId, conversionStart, traceId ? TraceNow() : 0);
 
-        // Check if the buffer is empty
-        if (buffer.Length() == 0) {
-            std::cerr << "Error: IBuffer is empty. No data to send to RX." << std::endl;
+        // Check if the message is empty
+        if (messageBytes.empty()) {
+            std::cerr << "Error: message is empty. No data to send to RX." << std::endl;
             return JNI_FALSE;
         }
 
-        // Write the data to the RX characteristic (micro:bit receives here)
-        // auto writeResult = rxCharacteristic.value().WriteValueAsync(buffer).get();
-        auto writeResult = rxCharacteristic->WriteValueAsync(buffer, GattWriteOption::WriteWithResponse).get();
+        // Write the data to the RX characteristic (micro:bit receives here) through the interactive lane
+        auto result = std::make_shared<std::promise<bool>>();
+        auto written = result->get_future();
+
+        if (!EnqueueOutbound(std::move(messageBytes), PRIORITY_INTERACTIVE, std::nullopt, [result](bool success) { result->set_value(success); }, false, traceId)) {
+            std::cerr << "Failed to queue data for RX!" << std::endl;
+            return JNI_FALSE;
+        }
 
-        if (SUCCEEDED(writeResult)) {
+        if (written.get()) {
             std::wcout << "Data written to RX: " << data << std::endl;
         }
         else {
@@ -815,12 +3339,341 @@ extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_blu
     }
 }
 
+// Function to queue a message without waiting, it is dropped if the deadline (ms from now, 0 = none) can not be met
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_enqueueWrite(JNIEnv* env, jobject obj, jstring dataStr, jint priority, jlong deadlineMs) {
+    try {
+        if (!GetConnectedDevice() || !GetRxCharacteristic()) {
+            std::cerr << "No device connected!" << std::endl;
+            return JNI_FALSE;
+        }
+
+        uint64_t traceId = TraceSample();
+        std::vector<uint8_t> messageBytes;
+        {
+            TraceScope scope("jni.GetStringUTFRegion", traceId);
+            messageBytes = JStringToUTF8Bytes(env, dataStr);
+        }
+
+        std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt;
+        if (deadlineMs > 0) {
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadlineMs);
+        }
+
+        return EnqueueOutbound(std::move(messageBytes), priority, deadline, nullptr, false, traceId) ? JNI_TRUE : JNI_FALSE;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception while queueing data for RX: " << e.what() << std::endl;
+        return JNI_FALSE;
+    }
+}
+
+// Function to stream a direct ByteBuffer (position to limit) to the RX characteristic
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_transferBuffer(JNIEnv* env, jobject obj, jobject buffer, jint checkpointBytes) {
+    try {
+        if (buffer == nullptr) {
+            std::cerr << "Error: buffer is null." << std::endl;
+            return JNI_FALSE;
+        }
+
+        auto address = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+        if (address == nullptr) {
+            std::cerr << "Error: buffer is not a direct ByteBuffer." << std::endl;
+            return JNI_FALSE;
+        }
+
+        jclass bufferClass = env->GetObjectClass(buffer);
+        jint position = env->CallIntMethod(buffer, env->GetMethodID(bufferClass, "position", "()I"));
+        jint limit = env->CallIntMethod(buffer, env->GetMethodID(bufferClass, "limit", "()I"));
+        env->DeleteLocalRef(bufferClass);
+
+        if (env->ExceptionCheck() || position < 0 || limit < position) {
+            env->ExceptionClear();
+            std::cerr << "Error: unable to read buffer bounds." << std::endl;
+            return JNI_FALSE;
+        }
+
+        return StartBulkTransfer(env, obj, std::vector<uint8_t>(address + position, address + limit), checkpointBytes);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception while transferring buffer: " << e.what() << std::endl;
+        return JNI_FALSE;
+    }
+}
+
+// Function to stream a file to the RX characteristic
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_transferFile(JNIEnv* env, jobject obj, jstring pathStr, jint checkpointBytes) {
+    try {
+        if (pathStr == nullptr) {
+            std::cerr << "Error: file path is null." << std::endl;
+            return JNI_FALSE;
+        }
+
+        const jchar* rawPath = env->GetStringChars(pathStr, nullptr);
+        if (rawPath == nullptr) {
+            std::cerr << "Error: Failed to retrieve string chars from file path." << std::endl;
+            return JNI_FALSE;
+        }
+        std::wstring path(rawPath, rawPath + env->GetStringLength(pathStr));
+        env->ReleaseStringChars(pathStr, rawPath);
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::wcerr << L"Unable to open file: " << path << std::endl;
+            return JNI_FALSE;
+        }
+
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return StartBulkTransfer(env, obj, std::move(data), checkpointBytes);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception while transferring file: " << e.what() << std::endl;
+        return JNI_FALSE;
+    }
+}
+
+// Function to resume the last unfinished bulk transfer from its last checkpoint, e.g. after a reconnect
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_resumeTransfer(JNIEnv* env, jobject obj) {
+    try {
+        if (!GetConnectedDevice() || !GetRxCharacteristic()) {
+            std::cerr << "No device connected!" << std::endl;
+            return JNI_FALSE;
+        }
+
+        if (isTransferring.exchange(true)) {
+            std::cerr << "Bulk transfer already in progress." << std::endl;
+            return JNI_FALSE;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(bulkMutex);
+            if (!bulkTransfer) {
+                std::cerr << "No bulk transfer to resume." << std::endl;
+                isTransferring.store(false);
+                return JNI_FALSE;
+            }
+
+            std::cout << "Resuming bulk transfer at " << bulkTransfer->checkpoint << " of " << bulkTransfer->data.size() << " bytes." << std::endl;
+        }
+
+        return RunBulkTransfer(env, obj);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Exception while resuming transfer: " << e.what() << std::endl;
+        return JNI_FALSE;
+    }
+}
+
+// Function to enable the throughput tuner within the given limits, or disable it and restore the default settings
+extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_configureTuner(JNIEnv* env, jobject obj, jboolean enabled, jint minWindow, jint maxWindow, jint maxCoalesceBytes, jboolean allowWithoutResponse) {
+    {
+        std::lock_guard<std::mutex> lock(tunerMutex);
+
+        tunerConfig.enabled = enabled == JNI_TRUE;
+        tunerConfig.minWindow = (uint32_t)(std::max)(1, (int)minWindow);
+        tunerConfig.maxWindow = (std::max)(tunerConfig.minWindow, (uint32_t)(std::max)(1, (int)maxWindow));
+        tunerConfig.maxCoalesce = (uint32_t)(std::max)(0, (int)maxCoalesceBytes);
+        tunerConfig.allowWithoutResponse = allowWithoutResponse == JNI_TRUE;
+    }
+
+    ResetWriterTuning();
+}
+
+// Function to open a logical channel, frames are queued in `priority` with at most `credit` frames waiting at once
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_openChannel(JNIEnv* env, jobject obj, jint channelId, jint priority, jint credit, jint maxPendingBytes) {
+    if (channelId < 0 || channelId >= CHANNEL_COUNT || priority < 0 || priority >= PRIORITY_COUNT) {
+        std::cerr << "Error: invalid channel or priority." << std::endl;
+        return JNI_FALSE;
+    }
+
+    if (globalObj == nullptr) {
+        saveGlobalReference(env, obj);
+    }
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    Channel& channel = channels[channelId];
+
+    if (!channel.open && openChannelCount++ == 0) {
+        channelInbound.clear(); // The stream switches to frames, earlier raw bytes are not a frame prefix
+    }
+
+    channel.open = true;
+    channel.priority = priority;
+    channel.credit = (uint32_t)(std::max)(1, (int)credit);
+    channel.maxPendingBytes = (size_t)(std::max)(1, (int)maxPendingBytes);
+    return JNI_TRUE;
+}
+
+// Function to close a logical channel, frames that were not queued yet are dropped
+extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_closeChannel(JNIEnv* env, jobject obj, jint channelId) {
+    if (channelId < 0 || channelId >= CHANNEL_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    Channel& channel = channels[channelId];
+
+    if (channel.open && --openChannelCount == 0) {
+        channelInbound.clear(); // Back to the raw stream, a partial frame would misalign the next channel session
+    }
+
+    channel.open = false;
+    channel.pending.clear();
+    channel.pendingBytes = 0;
+}
+
+// Function to write data on a logical channel, returns false when the channel's buffer is full
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_writeChannel(JNIEnv* env, jobject obj, jint channelId, jbyteArray data) {
+    if (data == nullptr) {
+        return JNI_FALSE;
+    }
+
+    if (!GetConnectedDevice() || !GetRxCharacteristic()) {
+        std::cerr << "No device connected!" << std::endl;
+        return JNI_FALSE;
+    }
+
+    jsize length = env->GetArrayLength(data);
+    std::vector<uint8_t> bytes(length);
+    env->GetByteArrayRegion(data, 0, length, reinterpret_cast<jbyte*>(bytes.data()));
+
+    return WriteChannel(channelId, bytes.data(), bytes.size()) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Function to enable tracing of every `sampleEvery`th message, or disable it
+extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_configureTracing(JNIEnv* env, jobject obj, jboolean enabled, jint sampleEvery) {
+    traceSampleEvery.store((uint32_t)(std::max)(1, (int)sampleEvery));
+    tracingEnabled.store(enabled == JNI_TRUE);
+}
+
+// Function to export the recorded stages as Chrome / Perfetto trace JSON
+extern "C" __declspec(dllexport) jstring JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_dumpTrace(JNIEnv* env, jobject obj, jboolean clear) {
+    std::string json = DumpTrace(clear == JNI_TRUE);
+    return env->NewStringUTF(json.c_str());
+}
+
+// Function to decode a subscription (-1 for the raw TX stream, or a channel id) with a binary frame schema
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_setFrameSchema(JNIEnv* env, jobject obj, jint subscription, jbyteArray fieldTypes, jfloatArray scales, jfloatArray offsets, jboolean bigEndian, jint batchFrames, jboolean shortOutput) {
+    if (fieldTypes == nullptr || scales == nullptr || offsets == nullptr || subscription < RAW_SUBSCRIPTION || subscription >= CHANNEL_COUNT) {
+        std::cerr << "Error: invalid frame schema." << std::endl;
+        return JNI_FALSE;
+    }
+
+    jsize fieldCount = env->GetArrayLength(fieldTypes);
+    if (fieldCount == 0 || env->GetArrayLength(scales) != fieldCount || env->GetArrayLength(offsets) != fieldCount) {
+        std::cerr << "Error: frame schema arrays must have the same, non zero length." << std::endl;
+        return JNI_FALSE;
+    }
+
+    std::vector<jbyte> types(fieldCount);
+    std::vector<jfloat> fieldScales(fieldCount);
+    std::vector<jfloat> fieldOffsets(fieldCount);
+    env->GetByteArrayRegion(fieldTypes, 0, fieldCount, types.data());
+    env->GetFloatArrayRegion(scales, 0, fieldCount, fieldScales.data());
+    env->GetFloatArrayRegion(offsets, 0, fieldCount, fieldOffsets.data());
+
+    FrameDecoder decoder;
+    decoder.bigEndian = bigEndian == JNI_TRUE;
+    decoder.shortOutput = shortOutput == JNI_TRUE;
+    decoder.batchFrames = (size_t)(std::max)(1, (int)batchFrames);
+
+    for (jsize i = 0; i < fieldCount; i++) {
+        if (types[i] < 0 || types[i] >= FIELD_TYPE_COUNT) {
+            std::cerr << "Error: unknown field type " << (int)types[i] << "." << std::endl;
+            return JNI_FALSE;
+        }
+
+        FieldType type = (FieldType)types[i];
+        if (decoder.shortOutput && type != FIELD_INT16 && type != FIELD_UINT16) {
+            std::cerr << "Error: short output needs 16 bit fields only." << std::endl;
+            return JNI_FALSE;
+        }
+
+        decoder.fields.push_back({ type, decoder.frameSize, fieldScales[i], fieldOffsets[i] });
+        decoder.frameSize += FieldSize(type);
+    }
+
+    if (globalObj == nullptr) {
+        saveGlobalReference(env, obj);
+    }
+
+    std::lock_guard<std::mutex> lock(decoderMutex);
+    frameDecoders[subscription] = std::move(decoder);
+    decoderCount.store((int)frameDecoders.size());
+    return JNI_TRUE;
+}
+
+// Function to stop decoding a subscription, its data goes back to the regular callbacks
+extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_clearFrameSchema(JNIEnv* env, jobject obj, jint subscription) {
+    std::lock_guard<std::mutex> lock(decoderMutex);
+    frameDecoders.erase(subscription);
+    decoderCount.store((int)frameDecoders.size());
+}
+
+// Function to deliver notifications through `onNotificationBatch`, flushed at `maxCount` notifications or after `maxLatencyMillis`; 0 turns batching off
+extern "C" __declspec(dllexport) jboolean JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_configureNotificationBatching(JNIEnv* env, jobject obj, jint maxCount, jint maxLatencyMillis, jint bufferBytes) {
+    if (maxCount <= 0) {
+        StopNotificationBatching(env);
+        return JNI_TRUE;
+    }
+
+    size_t capacity = (std::max)(MIN_BATCH_BUFFER_BYTES, (size_t)(std::max)(0, (int)bufferBytes));
+    auto latency = std::chrono::milliseconds((std::max)(1, (int)maxLatencyMillis));
+    return StartNotificationBatching(env, obj, (int)maxCount, latency, capacity) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Function to read all metric counters, indexed by MetricIndex
+extern "C" __declspec(dllexport) jlongArray JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_getMetrics(JNIEnv* env, jobject obj) {
+    jlong values[METRIC_COUNT];
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        values[i] = (jlong)metrics[i].load();
+    }
+
+    jlongArray result = env->NewLongArray(METRIC_COUNT);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, METRIC_COUNT, values);
+    }
+    return result;
+}
+
 // Cleanup to release all threaths
 extern "C" __declspec(dllexport) void JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_cleanup(JNIEnv* env, jobject obj) {
     cleanup(env);
     std::wcout << L"Bluetooth searvice cleaned up successfully." << std::endl;
 }
 
+// Function to tear down with a custom per step deadline, returns the TeardownFlag bits left unclean
+extern "C" __declspec(dllexport) jint JNICALL Java_com_bitbybit_services_bluetooth_BluetoothBLE_teardown(JNIEnv* env, jobject obj, jint stepTimeoutMs) {
+    return cleanup(env, stepTimeoutMs > 0 ? std::chrono::milliseconds(stepTimeoutMs) : DEFAULT_TEARDOWN_TIMEOUT);
+}
+
+// Creating the native runtime once when `System.loadLibrary` loads the library
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
+    runtime.loadedAt = TraceNow();
+    runtime.jvm = vm;
+    runtime.unloading.store(false);
+    runtime.readyPromise = std::promise<bool>(); // A module kept loaded by leftover threads is loaded again
+    runtime.ready = runtime.readyPromise.get_future().share();
+
+    JNIEnv* env;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+
+    // One multi threaded apartment for the whole process, Java threads calling in need no apartment of their own
+    if (FAILED(CoIncrementMTAUsage(&runtime.mtaCookie))) {
+        std::cerr << "Failed to initialize the multi threaded apartment" << std::endl;
+        runtime.mtaCookie = nullptr;
+    }
+
+    // Resolve classes and callbacks now, the loader of BluetoothBLE is only reachable from here
+    CacheJavaClasses(env);
+
+    // Bluetooth components load in the background, `initialize` waits for them through the ready future
+    StartLibraryThread(WarmUpRuntime).detach();
+
+    return JNI_VERSION_1_6;
+}
+
 // Automatically calling unload when the class is unloaded 
 extern "C" JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void* reserved) {
     std::wcout << L"Unloading BTE-Intercat service." << std::endl;
@@ -830,6 +3683,47 @@ extern "C" JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void* reserved) {
         return; // Exit if unable to get JNI environment
     }
 
+    // The warm-up starts the writer, give it a step deadline to finish so cleanup stops that writer for good
+    runtime.unloading.store(true);
+    if (runtime.ready.valid() && runtime.ready.wait_for(DEFAULT_TEARDOWN_TIMEOUT) != std::future_status::ready) {
+        std::cerr << "Runtime warm-up still running while unloading" << std::endl;
+    }
+
     // Perform cleanup
     cleanup(env);
-}
\ No newline at end of file
+    StopNotificationBatching(env);
+
+    // Threads left behind by teardown (a stuck writer, deadline steps) hold a module reference,
+    // waiting only lets the ones that are about to finish release it before the JVM frees the library
+    auto threadsDeadline = std::chrono::steady_clock::now() + DEFAULT_TEARDOWN_TIMEOUT;
+    while (libraryThreads.load() > 0 && std::chrono::steady_clock::now() < threadsDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    int threadsLeft = libraryThreads.load();
+    metrics[METRIC_UNLOAD_THREADS_LEFT].store(threadsLeft);
+    if (threadsLeft > 0) {
+        std::cerr << threadsLeft << " native thread(s) still running, the library stays loaded until they exit" << std::endl;
+    }
+
+    ReleaseJavaClasses(env);
+
+    if (runtime.mtaCookie != nullptr) {
+        CoDecrementMTAUsage(runtime.mtaCookie);
+        runtime.mtaCookie = nullptr;
+    }
+}
+
+// Called from DllMain on DLL_PROCESS_DETACH, before the global destructors run
+// On process exit every other thread is already gone, on unload every library thread has dropped its module
+// reference; either way a still joinable std::thread global would call std::terminate in its destructor. The
+// last library thread may be the one running this from FreeLibraryAndExitThread. Takes no locks, a terminated
+// thread may have died holding one.
+void ReleaseLibraryThreads() {
+    if (outboundWriter.joinable()) {
+        outboundWriter.detach();
+    }
+    if (batchDelivery.joinable()) {
+        batchDelivery.detach();
+    }
+}
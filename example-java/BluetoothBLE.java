@@ -1,6 +1,10 @@
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.List;
+import java.util.concurrent.CompletableFuture;
 import java.util.concurrent.Executors;
 import java.util.concurrent.ScheduledExecutorService;
 import java.util.concurrent.TimeUnit;
@@ -11,6 +15,61 @@ import java.util.stream.Collectors;
  */
 public class BluetoothBLE {
 
+	// Outbound priority lanes, a higher lane is served first once the current message finishes.
+	public static final int PRIORITY_CONTROL = 0;
+	public static final int PRIORITY_INTERACTIVE = 1;
+	public static final int PRIORITY_BULK = 2;
+
+	// Indexes into the array returned by getMetrics().
+	public static final int METRIC_SENT_CONTROL = 0;
+	public static final int METRIC_SENT_INTERACTIVE = 1;
+	public static final int METRIC_SENT_BULK = 2;
+	public static final int METRIC_DROPPED_CONTROL = 3;
+	public static final int METRIC_DROPPED_INTERACTIVE = 4;
+	public static final int METRIC_DROPPED_BULK = 5;
+	public static final int METRIC_FRAGMENTS_WRITTEN = 6;
+	public static final int METRIC_WRITE_FAILURES = 7;
+	public static final int METRIC_FRAGMENT_SIZE = 8;
+	public static final int METRIC_UNCLEAN_TEARDOWNS = 9;
+	public static final int METRIC_BYTES_WRITTEN = 10;
+	public static final int METRIC_WRITE_WINDOW = 11;
+	public static final int METRIC_COALESCE_BYTES = 12;
+	public static final int METRIC_WRITE_MODE = 13;
+	public static final int METRIC_ROUND_TRIP_MICROS = 14;
+	public static final int METRIC_THROUGHPUT = 15;
+	public static final int METRIC_CHANNEL_FRAMES_SENT = 16;
+	public static final int METRIC_CHANNEL_FRAMES_FAILED = 17;
+	public static final int METRIC_CHANNEL_FRAMES_RECEIVED = 18;
+	public static final int METRIC_CHANNEL_REJECTED = 19;
+	public static final int METRIC_NOTIFICATION_BATCHES = 20;
+	public static final int METRIC_NOTIFICATIONS_BATCHED = 21;
+	public static final int METRIC_NOTIFICATIONS_DROPPED = 22;
+	public static final int METRIC_COLD_START_MICROS = 23;
+	public static final int METRIC_FIRST_SCAN_MICROS = 24;
+	public static final int METRIC_UNLOAD_THREADS_LEFT = 25;
+
+	// Layout of a record in onNotificationBatch: timestamp, session, channel, length, payload.
+	private static final int BATCH_RECORD_HEADER = 16;
+	private static final int BATCH_RAW_CHANNEL = -1;
+
+	// Field types of a binary frame schema, see setFrameSchema().
+	public static final byte FIELD_UINT8 = 0;
+	public static final byte FIELD_INT8 = 1;
+	public static final byte FIELD_UINT16 = 2;
+	public static final byte FIELD_INT16 = 3;
+	public static final byte FIELD_UINT32 = 4;
+	public static final byte FIELD_INT32 = 5;
+	public static final byte FIELD_FLOAT32 = 6;
+
+	// Subscription id of the raw TX stream, channels use their channel id.
+	public static final int RAW_SUBSCRIPTION = -1;
+
+	// Bits returned by teardown() for steps that did not finish cleanly.
+	public static final int TEARDOWN_WRITER = 1;
+	public static final int TEARDOWN_UNSUBSCRIBE = 2;
+	public static final int TEARDOWN_HANDLERS = 4;
+	public static final int TEARDOWN_CLOSE = 8;
+
 	// Load the native library containing JNI methods.
 	static {
 		System.loadLibrary("BleInteract");
@@ -30,18 +89,26 @@ public class BluetoothBLE {
 	// Connected device
 	private String connectedDevice;
 
+	// Listeners of the open logical channels, indexed by channel id
+	private final ChannelListener[] channelListeners = new ChannelListener[256];
+
+	/**
+	 * Receives the payload of frames on a logical channel.
+	 */
+	public interface ChannelListener {
+		void onData(byte[] data);
+	}
+
 	/**
 	 * Object constructor
 	 */
 	public BluetoothBLE() {
-		new Thread(() -> {
-			try {
-				this.initialize();
-				System.out.println("Apartment initialized successfully");
-			} catch (Exception e) {
-				e.printStackTrace();
-			}
-		}).start();
+		// The native runtime is created when the library loads, wait until it is warm
+		if (this.initialize()) {
+			System.out.println("Native runtime ready");
+		} else {
+			System.err.println("Native runtime not ready, Bluetooth may be unavailable");
+		}
 	}
 
 	/** Get connected device */
@@ -50,10 +117,16 @@ public class BluetoothBLE {
 	}
 
 	/**
-	 * Initialize object
+	 * Initialize object, waits for the native runtime to finish warming up
 	 */
 	private native boolean initialize();
 
+	/**
+	 * Waits up to timeoutMs for the native runtime, returns true once the
+	 * Bluetooth stack is loaded and ready for the first scan.
+	 */
+	public native boolean awaitReady(int timeoutMs);
+
 	/**
 	 * Searches for available BLE devices.
 	 */
@@ -64,6 +137,15 @@ public class BluetoothBLE {
 	 */
 	private native boolean connectDevice(String deviceAddress);
 
+	/**
+	 * Scans for the first device matching the target, connects and initializes
+	 * UART in one call. Unused target fields may be null. timeoutMs bounds the
+	 * scan, the device lookup and the UART resolution together. Returns the device
+	 * address, or null when nothing matched or connected within timeoutMs.
+	 */
+	private native String connectToTarget(String deviceAddress, String namePattern, String serviceUuid,
+			String uartServiceId, String rxUUID, String txUUID, int timeoutMs);
+
 	/**
 	 * Disconnects from the currently connected BLE device.
 	 */
@@ -79,11 +161,102 @@ public class BluetoothBLE {
 	 */
 	private native boolean writeToRX(String message);
 
+	/**
+	 * Queues a message in a priority lane without waiting for it to be written.
+	 * The message is dropped if it can not be sent within deadlineMs (0 = no deadline).
+	 */
+	private native boolean enqueueWrite(String message, int priority, long deadlineMs);
+
+	/**
+	 * Streams a direct buffer (position to limit) to the device with a window of
+	 * writes in flight and an acknowledged checkpoint every checkpointBytes. Each
+	 * segment carries its offset so the device can drop bytes replayed on resume.
+	 */
+	public native boolean transferBuffer(java.nio.ByteBuffer buffer, int checkpointBytes);
+
+	/**
+	 * Streams a file to the device, see transferBuffer.
+	 */
+	public native boolean transferFile(String path, int checkpointBytes);
+
+	/**
+	 * Resumes the last unfinished transfer from its last checkpoint, e.g. after a
+	 * reconnect.
+	 */
+	public native boolean resumeTransfer();
+
+	/**
+	 * Enables the throughput tuner, which adapts the write window, coalescing
+	 * size and write mode within these limits. Disabling restores the defaults.
+	 */
+	public native void configureTuner(boolean enabled, int minWindow, int maxWindow, int maxCoalesceBytes,
+			boolean allowWithoutResponse);
+
+	/**
+	 * Opens a logical channel. Its frames are queued in the given priority lane,
+	 * with at most credit frames waiting at once and maxPendingBytes buffered.
+	 */
+	private native boolean openChannel(int channel, int priority, int credit, int maxPendingBytes);
+
+	/**
+	 * Closes a logical channel.
+	 */
+	private native void closeChannel(int channel);
+
+	/**
+	 * Writes data on a logical channel, returns false when its buffer is full.
+	 */
+	public native boolean writeChannel(int channel, byte[] data);
+
+	/**
+	 * Decodes a subscription with a binary frame schema. Each frame holds the
+	 * fields in order, decoded as value * scale + offset and delivered as columns
+	 * of batchFrames frames through onSensorBatch (or onSensorBatchRaw for
+	 * shortOutput).
+	 */
+	public native boolean setFrameSchema(int subscription, byte[] fieldTypes, float[] scales, float[] offsets,
+			boolean bigEndian, int batchFrames, boolean shortOutput);
+
+	/**
+	 * Stops decoding a subscription.
+	 */
+	public native void clearFrameSchema(int subscription);
+
+	/**
+	 * Delivers notifications with one call to onNotificationBatch, flushed once
+	 * maxCount are waiting or the oldest has waited maxLatencyMs. A maxCount of
+	 * 0 turns batching off.
+	 */
+	public native boolean configureNotificationBatching(int maxCount, int maxLatencyMs, int bufferBytes);
+
+	/**
+	 * Enables tracing of every sampleEvery-th message through the write and
+	 * notification paths, or disables it.
+	 */
+	public native void configureTracing(boolean enabled, int sampleEvery);
+
+	/**
+	 * Exports the recorded stages as Chrome / Perfetto trace JSON, optionally
+	 * clearing them.
+	 */
+	public native String dumpTrace(boolean clear);
+
+	/**
+	 * Reads the native metric counters, see the METRIC_* indexes.
+	 */
+	public native long[] getMetrics();
+
 	/**
 	 * Cleans up native resources.
 	 */
 	public native void cleanup();
 
+	/**
+	 * Cleans up native resources with a deadline for each step, returns the
+	 * TEARDOWN_* bits of the steps that were left unclean.
+	 */
+	public native int teardown(int stepTimeoutMs);
+
 	/**
 	 * Handles device disconnection event.
 	 */
@@ -105,6 +278,69 @@ public class BluetoothBLE {
 		}
 	}
 
+	/**
+	 * Handles a frame received on a logical channel.
+	 */
+	private void onChannelData(int channel, byte[] data) {
+		ChannelListener listener = channelListeners[channel];
+		if (listener != null) {
+			listener.onData(data);
+		}
+	}
+
+	/**
+	 * Handles a batch of notifications. The buffer is reused by the native side
+	 * and is only valid during this call.
+	 */
+	private void onNotificationBatch(ByteBuffer packed, int count) {
+		packed.order(ByteOrder.LITTLE_ENDIAN);
+		int position = 0;
+		for (int i = 0; i < count; i++) {
+			short channel = packed.getShort(position + 12);
+			int length = packed.getShort(position + 14) & 0xFFFF;
+
+			byte[] data = new byte[length];
+			packed.position(position + BATCH_RECORD_HEADER);
+			packed.get(data);
+			position += BATCH_RECORD_HEADER + length;
+
+			if (channel == BATCH_RAW_CHANNEL) {
+				if (this.eventListener != null) {
+					this.eventListener.onSerialReceived(new String(data, StandardCharsets.UTF_8));
+				}
+			} else {
+				onChannelData(channel, data);
+			}
+		}
+	}
+
+	/**
+	 * Handles a decoded batch, column f holds frames values starting at f * frames.
+	 */
+	private void onSensorBatch(int subscription, float[] columns, int frames, int fields) {
+		if (this.eventListener != null) {
+			this.eventListener.onSensorBatch(subscription, columns, frames, fields);
+		}
+	}
+
+	/**
+	 * Handles a decoded batch of raw 16 bit samples, laid out like onSensorBatch.
+	 */
+	private void onSensorBatchRaw(int subscription, short[] columns, int frames, int fields) {
+		if (this.eventListener != null) {
+			this.eventListener.onSensorBatchRaw(subscription, columns, frames, fields);
+		}
+	}
+
+	/**
+	 * Handles bulk transfer progress, called at most every 100 ms.
+	 */
+	private void onTransferProgress(long sent, long total) {
+		if (this.eventListener != null) {
+			this.eventListener.onTransferProgress(sent, total);
+		}
+	}
+
 	/**
 	 * Handles device connection event.
 	 */
@@ -129,6 +365,34 @@ public class BluetoothBLE {
 		this.rxCharacteristic = receiveId;
 	}
 
+	/**
+	 * Opens a logical channel and registers its listener once the channel is
+	 * open. Returns false for an out-of-range id or when the native open fails.
+	 */
+	public boolean openChannel(int channel, int priority, int credit, int maxPendingBytes, ChannelListener listener) {
+		if (channel < 0 || channel >= channelListeners.length) {
+			return false;
+		}
+
+		if (!openChannel(channel, priority, credit, maxPendingBytes)) {
+			return false;
+		}
+		channelListeners[channel] = listener;
+		return true;
+	}
+
+	/**
+	 * Closes a logical channel and drops its listener.
+	 */
+	public void removeChannel(int channel) {
+		if (channel < 0 || channel >= channelListeners.length) {
+			return;
+		}
+
+		closeChannel(channel);
+		channelListeners[channel] = null;
+	}
+
 	/**
 	 * Sends a message using the RX characteristic.
 	 */
@@ -147,6 +411,20 @@ public class BluetoothBLE {
 		}
 	}
 
+	/**
+	 * Queues a message in the given priority lane, see PRIORITY_*.
+	 */
+	public boolean sendSerialMessage(String message, int priority, long deadlineMs) {
+		if (connectedDevice == null) {
+			if (this.eventListener != null) {
+				this.eventListener.onDeviceDisconnected();
+			}
+			return false;
+		}
+
+		return enqueueWrite(message + "\n", priority, deadlineMs);
+	}
+
 	/**
 	 * Discovers available BLE devices.
 	 */
@@ -196,13 +474,39 @@ public class BluetoothBLE {
 		task.start();
 	}
 
+	/**
+	 * Scan for a target and connect to it on the class scheduler, completes with
+	 * the device address or null
+	 */
+	public CompletableFuture<String> connectToTargetAsync(String deviceAddress, String namePattern,
+			String serviceUuid, int timeoutMs) {
+		return CompletableFuture.supplyAsync(() -> {
+			String address = this.connectToTarget(deviceAddress, namePattern, serviceUuid, this.uartService,
+					this.rxCharacteristic, this.txCharacteristic, timeoutMs);
+
+			if (this.eventListener != null) {
+				if (address != null) {
+					this.connectedDevice = address;
+					this.eventListener.onDeviceConnected(address);
+				} else {
+					this.eventListener.onDeviceFailConnect();
+				}
+			} else if (address != null) {
+				this.connectedDevice = address;
+			}
+			return address;
+		}, scheduler);
+	}
+
 	/**
 	 * Clean the BLEService threads avoiding it hanging in the background when not
 	 * needed
 	 */
 	public void clear() {
-		this.disconnectDevice();
-		this.cleanup();
+		int unclean = this.teardown(500);
+		if (unclean != 0) {
+			System.out.println("Teardown left unclean steps: " + unclean);
+		}
 	}
 
 	// Main method for testing the BluetoothBLE functionality.
@@ -13,4 +13,13 @@ public interface BluetoothEventListener {
 	void onDiscoveryFailed();
 
 	void onDeviceFailConnect();
+
+	default void onTransferProgress(long sent, long total) {
+	}
+
+	default void onSensorBatch(int subscription, float[] columns, int frames, int fields) {
+	}
+
+	default void onSensorBatchRaw(int subscription, short[] columns, int frames, int fields) {
+	}
 }
\ No newline at end of file